@@ -0,0 +1,80 @@
+#pragma once
+/*
+ * S16 -> FLTP 采样格式转换
+ * Interleaved signed 16 bit -> planar float sample conversion.
+ *
+ * This is the conversion an audio encode path hits most: capture and
+ * synthesis deliver interleaved S16, while AAC, Vorbis, Opus and AC-3
+ * encoders take planar float. The result matches libswresample exactly,
+ * each sample is v / 32768.
+ * Stereo and mono have SSE2 loops, other layouts use the C loop.
+ */
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "libavutil/cpu.h"
+#ifdef __cplusplus
+}
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define AUDIO_CONVERT_HAVE_X86 1
+#include <immintrin.h>
+#else
+#define AUDIO_CONVERT_HAVE_X86 0
+#endif
+
+typedef void (*S16ToFltpFunc)(float *const *dst, const int16_t *src, int channels, int nb_samples);
+
+/* converts samples [i0, nb_samples) */
+static inline void s16_to_fltp_tail(float *const *dst, const int16_t *src, int channels, int i0, int nb_samples)
+{
+    int i, ch;
+    for (i = i0; i < nb_samples; i++)
+        for (ch = 0; ch < channels; ch++)
+            dst[ch][i] = src[i * channels + ch] * (1.0f / (1 << 15));
+}
+
+static inline void s16_to_fltp_c(float *const *dst, const int16_t *src, int channels, int nb_samples)
+{
+    s16_to_fltp_tail(dst, src, channels, 0, nb_samples);
+}
+
+#if AUDIO_CONVERT_HAVE_X86
+__attribute__((target("sse2")))
+static inline void s16_to_fltp_sse2(float *const *dst, const int16_t *src, int channels, int nb_samples)
+{
+    const __m128 scale = _mm_set1_ps(1.0f / (1 << 15));
+    int i = 0;
+
+    if (channels == 2) {
+        // 4 stereo pairs: L0 R0 L1 R1 | L2 R2 L3 R3 -> L0..L3, R0..R3
+        for (; i + 4 <= nb_samples; i += 4) {
+            __m128i s  = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+            __m128  lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16)), scale);
+            __m128  hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16)), scale);
+            _mm_storeu_ps(dst[0] + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(dst[1] + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+    } else if (channels == 1) {
+        for (; i + 8 <= nb_samples; i += 8) {
+            __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+            _mm_storeu_ps(dst[0] + i,     _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16)), scale));
+            _mm_storeu_ps(dst[0] + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16)), scale));
+        }
+    }
+    s16_to_fltp_tail(dst, src, channels, i, nb_samples);
+}
+#endif
+
+static inline S16ToFltpFunc s16_to_fltp_get_func(int cpu_flags)
+{
+#if AUDIO_CONVERT_HAVE_X86
+    if (cpu_flags & AV_CPU_FLAG_SSE2)
+        return s16_to_fltp_sse2;
+#endif
+    return s16_to_fltp_c;
+}
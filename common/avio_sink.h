@@ -0,0 +1,316 @@
+#pragma once
+/*
+ * 自定义输出 AVIOContext
+ * Custom output backends for libavformat.
+ *
+ * avio_open writes through a small buffer, so a muxer issues one write()
+ * for every few KB of output. An AvioSink supplies its own AVIOContext
+ * instead, backed by one of:
+ *
+ *   FILE_SINK    a file, with a large AVIO buffer; the small writes AVIO
+ *                still makes when it flushes are coalesced into one
+ *                buffer of the same size before they reach write()
+ *   MEMORY_SINK  a growing memory buffer; nothing touches the disk and the
+ *                finished bytes are handed to the caller
+ *   MMAP_SINK    a file mapped into memory, presized and grown as needed,
+ *                truncated to the real size by finish()
+ *   CALLBACK_SINK  caller supplied write (and optionally seek) functions,
+ *                e.g. straight into an HTTP response
+ *
+ * The first three are seekable, so formats that patch their header at the
+ * end (mp4, mov, ...) work unchanged. A callback sink is seekable only
+ * with a seek function; otherwise mp4 needs fragmenting (movflags).
+ *
+ *   AvioSink *sink = AvioSink::openMemory(0);
+ *   oc->pb = sink->context();
+ *   ... avformat_write_header, packets, av_write_trailer ...
+ *   sink->finish();
+ *   sink->takeBuffer(bytes);
+ *   delete sink;
+ */
+#include <vector>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "libavformat/avio.h"
+#include "libavutil/mem.h"
+#ifdef __cplusplus
+}
+#endif
+
+#define AVIO_SINK_DEFAULT_BUFFER (1 << 20)
+// memory backends only copy, a big AVIO buffer would not save anything
+#define AVIO_SINK_MEM_IO_BUFFER  (64 << 10)
+
+typedef int (*AvioWriteFunc)(void *opaque, uint8_t *buf, int size);
+typedef int64_t (*AvioSinkSeekFunc)(void *opaque, int64_t offset, int whence);
+
+class AvioSink{
+public:
+    enum Mode { FILE_SINK, MEMORY_SINK, MMAP_SINK, CALLBACK_SINK };
+private:
+    Mode m_mode;
+    AVIOContext *m_pb;
+    int m_fd;
+    // FILE_SINK: bytes waiting to be written at the current file position
+    std::vector<uint8_t> m_pending;
+    size_t m_pendingSize;
+    // MEMORY_SINK
+    std::vector<uint8_t> m_mem;
+    // MMAP_SINK
+    uint8_t *m_map;
+    size_t m_mapSize;
+    // MEMORY_SINK and MMAP_SINK: write position and size of the output
+    size_t m_pos, m_end;
+    // CALLBACK_SINK
+    AvioWriteFunc m_write;
+    AvioSinkSeekFunc m_seek;
+    void *m_opaque;
+    long m_writeCalls, m_syscalls;
+private:
+    AvioSink( const AvioSink& s );
+    AvioSink& operator=( const AvioSink& s );
+
+    AvioSink( Mode mode, int fd )
+        : m_mode( mode ), m_pb( NULL ), m_fd( fd ), m_pendingSize( 0 ),
+          m_map( NULL ), m_mapSize( 0 ), m_pos( 0 ), m_end( 0 ),
+          m_write( NULL ), m_seek( NULL ), m_opaque( NULL ),
+          m_writeCalls( 0 ), m_syscalls( 0 )
+    {
+    }
+
+    bool allocContext( int ioBufferSize, bool seekable = true )
+    {
+        unsigned char *buf = (unsigned char *)av_malloc(ioBufferSize);
+        if (!buf)
+            return false;
+        m_pb = avio_alloc_context(buf, ioBufferSize, 1, this, NULL, writePacket, seekable ? seek : NULL);
+        if (!m_pb) {
+            av_free(buf);
+            return false;
+        }
+        return true;
+    }
+
+    int writeAll( const uint8_t *buf, size_t size )
+    {
+        while (size) {
+            ssize_t n = write(m_fd, buf, size);
+            ++m_syscalls;
+            if (n <= 0)
+                return AVERROR(EIO);
+            buf += n;
+            size -= n;
+        }
+        return 0;
+    }
+
+    int flushPending()
+    {
+        int ret = writeAll(m_pending.data(), m_pendingSize);
+        m_pendingSize = 0;
+        return ret;
+    }
+
+    // makes [0, size) of the mapping valid, growing the file geometrically
+    bool reserveMap( size_t size )
+    {
+        size_t newSize;
+        void *map;
+        if (size <= m_mapSize)
+            return true;
+        newSize = m_mapSize ? m_mapSize : 1 << 20;
+        while (newSize < size)
+            newSize *= 2;
+        if (ftruncate(m_fd, newSize) < 0)
+            return false;
+        if (m_map)
+            munmap(m_map, m_mapSize);
+        map = mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        m_map = map == MAP_FAILED ? NULL : (uint8_t *)map;
+        m_mapSize = m_map ? newSize : 0;
+        return m_map != NULL;
+    }
+
+    int append( const uint8_t *buf, int size )
+    {
+        ++m_writeCalls;
+        switch (m_mode) {
+        case FILE_SINK:
+            if (m_pendingSize + size > m_pending.size()) {
+                if (flushPending() < 0)
+                    return AVERROR(EIO);
+                // too big to coalesce, nothing gained by copying it
+                if ((size_t)size >= m_pending.size())
+                    return writeAll(buf, size) < 0 ? AVERROR(EIO) : size;
+            }
+            memcpy(m_pending.data() + m_pendingSize, buf, size);
+            m_pendingSize += size;
+            return size;
+        case MEMORY_SINK:
+            if (m_pos + size > m_mem.size())
+                m_mem.resize(m_pos + size);
+            memcpy(m_mem.data() + m_pos, buf, size);
+            break;
+        case MMAP_SINK:
+            if (!reserveMap(m_pos + size))
+                return AVERROR(ENOMEM);
+            memcpy(m_map + m_pos, buf, size);
+            break;
+        case CALLBACK_SINK:
+            return m_write(m_opaque, (uint8_t *)buf, size);
+        }
+        m_pos += size;
+        if (m_pos > m_end)
+            m_end = m_pos;
+        return size;
+    }
+
+    int64_t seekTo( int64_t offset, int whence )
+    {
+        int64_t pos;
+        if (m_mode == FILE_SINK) {
+            struct stat st;
+            if (flushPending() < 0)
+                return AVERROR(EIO);
+            if (whence == AVSEEK_SIZE)
+                return fstat(m_fd, &st) < 0 ? AVERROR(EIO) : (int64_t)st.st_size;
+            pos = lseek(m_fd, offset, whence & ~AVSEEK_FORCE);
+            return pos < 0 ? AVERROR(EIO) : pos;
+        }
+        if (m_mode == CALLBACK_SINK)
+            return m_seek(m_opaque, offset, whence);
+        switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE: return m_end;
+        case SEEK_SET:    pos = offset; break;
+        case SEEK_CUR:    pos = m_pos + offset; break;
+        case SEEK_END:    pos = m_end + offset; break;
+        default:          return AVERROR(EINVAL);
+        }
+        if (pos < 0)
+            return AVERROR(EINVAL);
+        m_pos = pos;
+        return pos;
+    }
+
+    static int writePacket( void *opaque, uint8_t *buf, int size )
+    {
+        return ((AvioSink *)opaque)->append(buf, size);
+    }
+
+    static int64_t seek( void *opaque, int64_t offset, int whence )
+    {
+        return ((AvioSink *)opaque)->seekTo(offset, whence);
+    }
+public:
+    ~AvioSink()
+    {
+        if (m_pb) {
+            av_freep(&m_pb->buffer);
+            av_freep(&m_pb);
+        }
+        if (m_map)
+            munmap(m_map, m_mapSize);
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    // writes to path through an AVIO buffer and a coalescing buffer of bufferSize bytes
+    static AvioSink *openFile( const char *path, int bufferSize = AVIO_SINK_DEFAULT_BUFFER )
+    {
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        AvioSink *s;
+        if (fd < 0)
+            return NULL;
+        s = new AvioSink(FILE_SINK, fd);
+        s->m_pending.resize(bufferSize);
+        if (!s->allocContext(bufferSize)) {
+            delete s;
+            return NULL;
+        }
+        return s;
+    }
+
+    // keeps the whole output in memory, initialSize is only a hint
+    static AvioSink *openMemory( size_t initialSize = 0 )
+    {
+        AvioSink *s = new AvioSink(MEMORY_SINK, -1);
+        s->m_mem.reserve(initialSize);
+        if (!s->allocContext(AVIO_SINK_MEM_IO_BUFFER)) {
+            delete s;
+            return NULL;
+        }
+        return s;
+    }
+
+    // maps path with presize bytes up front; the mapping grows if that is not enough
+    static AvioSink *openMmap( const char *path, size_t presize )
+    {
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        AvioSink *s;
+        if (fd < 0)
+            return NULL;
+        s = new AvioSink(MMAP_SINK, fd);
+        if ((presize && !s->reserveMap(presize)) || !s->allocContext(AVIO_SINK_MEM_IO_BUFFER)) {
+            delete s;
+            return NULL;
+        }
+        return s;
+    }
+
+    /* writeFn gets the output in order unless seekFn is given, in which
+     * case the muxer may seek back and rewrite (AVIO seek contract). */
+    static AvioSink *openCallback( AvioWriteFunc writeFn, AvioSinkSeekFunc seekFn, void *opaque )
+    {
+        AvioSink *s = new AvioSink(CALLBACK_SINK, -1);
+        s->m_write = writeFn;
+        s->m_seek = seekFn;
+        s->m_opaque = opaque;
+        if (!s->allocContext(AVIO_SINK_MEM_IO_BUFFER, seekFn != NULL)) {
+            delete s;
+            return NULL;
+        }
+        return s;
+    }
+
+    AVIOContext *context() { return m_pb; }
+    Mode mode() const { return m_mode; }
+
+    // pushes out everything buffered; call after av_write_trailer
+    int finish()
+    {
+        int ret = 0;
+        avio_flush(m_pb);
+        if (m_mode == FILE_SINK)
+            ret = flushPending();
+        else if (m_mode == MMAP_SINK && ftruncate(m_fd, m_end) < 0)
+            ret = AVERROR(EIO);
+        return ret;
+    }
+
+    // MEMORY_SINK and MMAP_SINK: the finished output
+    const uint8_t *data() const { return m_mode == MMAP_SINK ? m_map : m_mem.data(); }
+    size_t size() const { return m_end; }
+
+    // MEMORY_SINK: moves the finished output to the caller without a copy
+    void takeBuffer( std::vector<uint8_t>& out )
+    {
+        m_mem.resize(m_end);
+        out.swap(m_mem);
+        m_mem.clear();
+        m_pos = m_end = 0;
+    }
+
+    // callbacks from AVIO, and the write() calls they turned into (FILE_SINK)
+    long writeCalls() const { return m_writeCalls; }
+    long syscalls() const { return m_syscalls; }
+};
@@ -0,0 +1,217 @@
+#pragma once
+/*
+ * 自定义输入 AVIOContext
+ * Custom inputs for libavformat.
+ *
+ *   FILE_SOURCE      a file read through an AVIO buffer of any size;
+ *                    avio_open reads in small blocks, so a demuxer that
+ *                    only copies packets would spend its time in read().
+ *                    The kernel is told the access is sequential, so
+ *                    readahead keeps the disk busy.
+ *   MEMORY_SOURCE    a buffer the caller already holds, seekable, never
+ *                    copied except into the AVIO buffer
+ *   CALLBACK_SOURCE  caller supplied read (and optionally seek) functions,
+ *                    e.g. an HTTP body; seekable only with a seek function
+ *
+ *   AvioSource *src = AvioSource::openFile("in.ts", 1 << 20);
+ *   AVFormatContext *ic = avformat_alloc_context();
+ *   ic->pb = src->context();
+ *   avformat_open_input(&ic, "in.ts", NULL, NULL);
+ *   ... packets, avformat_close_input(&ic) ...
+ *   delete src;
+ *
+ * The AVFormatContext does not own the context (AVFMT_FLAG_CUSTOM_IO),
+ * so the source must outlive it.
+ */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "libavformat/avio.h"
+#include "libavutil/mem.h"
+#ifdef __cplusplus
+}
+#endif
+
+#define AVIO_SOURCE_DEFAULT_BUFFER (1 << 20)
+// memory and callback sources only copy, a big AVIO buffer would not save anything
+#define AVIO_SOURCE_MEM_IO_BUFFER  (64 << 10)
+
+typedef int (*AvioReadFunc)(void *opaque, uint8_t *buf, int size);
+typedef int64_t (*AvioSeekFunc)(void *opaque, int64_t offset, int whence);
+
+class AvioSource{
+public:
+    enum Mode { FILE_SOURCE, MEMORY_SOURCE, CALLBACK_SOURCE };
+private:
+    Mode m_mode;
+    AVIOContext *m_pb;
+    int m_fd;
+    // MEMORY_SOURCE
+    const uint8_t *m_data;
+    size_t m_size, m_pos;
+    // CALLBACK_SOURCE
+    AvioReadFunc m_read;
+    AvioSeekFunc m_seek;
+    void *m_opaque;
+    int64_t m_bytesRead;
+    long m_syscalls;
+private:
+    AvioSource( const AvioSource& s );
+    AvioSource& operator=( const AvioSource& s );
+
+    AvioSource( Mode mode, int fd )
+        : m_mode( mode ), m_pb( NULL ), m_fd( fd ), m_data( NULL ), m_size( 0 ), m_pos( 0 ),
+          m_read( NULL ), m_seek( NULL ), m_opaque( NULL ), m_bytesRead( 0 ), m_syscalls( 0 )
+    {
+    }
+
+    bool allocContext( int bufferSize, bool seekable )
+    {
+        unsigned char *buf = (unsigned char *)av_malloc(bufferSize);
+        if (!buf)
+            return false;
+        m_pb = avio_alloc_context(buf, bufferSize, 0, this, readPacket, NULL, seekable ? seek : NULL);
+        if (!m_pb) {
+            av_free(buf);
+            return false;
+        }
+        return true;
+    }
+
+    int readSome( uint8_t *buf, int size )
+    {
+        ssize_t n;
+        switch (m_mode) {
+        case FILE_SOURCE:
+            n = read(m_fd, buf, size);
+            ++m_syscalls;
+            break;
+        case MEMORY_SOURCE:
+            n = m_size - m_pos < (size_t)size ? m_size - m_pos : size;
+            memcpy(buf, m_data + m_pos, n);
+            m_pos += n;
+            break;
+        default:
+            n = m_read(m_opaque, buf, size);
+            if (n < 0)
+                return (int)n;
+            break;
+        }
+        if (n < 0)
+            return AVERROR(EIO);
+        if (n == 0)
+            return AVERROR_EOF;
+        m_bytesRead += n;
+        return (int)n;
+    }
+
+    int64_t seekTo( int64_t offset, int whence )
+    {
+        struct stat st;
+        int64_t pos;
+        switch (m_mode) {
+        case FILE_SOURCE:
+            if (whence == AVSEEK_SIZE)
+                return fstat(m_fd, &st) < 0 ? AVERROR(EIO) : (int64_t)st.st_size;
+            pos = lseek(m_fd, offset, whence & ~AVSEEK_FORCE);
+            return pos < 0 ? AVERROR(EIO) : pos;
+        case MEMORY_SOURCE:
+            switch (whence & ~AVSEEK_FORCE) {
+            case AVSEEK_SIZE: return m_size;
+            case SEEK_SET:    pos = offset; break;
+            case SEEK_CUR:    pos = m_pos + offset; break;
+            case SEEK_END:    pos = m_size + offset; break;
+            default:          return AVERROR(EINVAL);
+            }
+            if (pos < 0 || pos > (int64_t)m_size)
+                return AVERROR(EINVAL);
+            m_pos = pos;
+            return pos;
+        default:
+            return m_seek(m_opaque, offset, whence);
+        }
+    }
+
+    static int readPacket( void *opaque, uint8_t *buf, int size )
+    {
+        return ((AvioSource *)opaque)->readSome(buf, size);
+    }
+
+    static int64_t seek( void *opaque, int64_t offset, int whence )
+    {
+        return ((AvioSource *)opaque)->seekTo(offset, whence);
+    }
+public:
+    ~AvioSource()
+    {
+        if (m_pb) {
+            av_freep(&m_pb->buffer);
+            av_freep(&m_pb);
+        }
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    // reads path through an AVIO buffer of bufferSize bytes
+    static AvioSource *openFile( const char *path, int bufferSize = AVIO_SOURCE_DEFAULT_BUFFER )
+    {
+        int fd = open(path, O_RDONLY);
+        AvioSource *s;
+        if (fd < 0)
+            return NULL;
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        s = new AvioSource(FILE_SOURCE, fd);
+        if (!s->allocContext(bufferSize, true)) {
+            delete s;
+            return NULL;
+        }
+        return s;
+    }
+
+    // reads size bytes at data, which must stay valid while the source is used
+    static AvioSource *openMemory( const uint8_t *data, size_t size, int bufferSize = AVIO_SOURCE_MEM_IO_BUFFER )
+    {
+        AvioSource *s = new AvioSource(MEMORY_SOURCE, -1);
+        s->m_data = data;
+        s->m_size = size;
+        if (!s->allocContext(bufferSize, true)) {
+            delete s;
+            return NULL;
+        }
+        return s;
+    }
+
+    /* readFn returns the bytes read, 0 or AVERROR_EOF at the end; seekFn
+     * follows the AVIO seek contract (AVSEEK_SIZE included) and may be
+     * NULL for a stream that can only be read forward. */
+    static AvioSource *openCallback( AvioReadFunc readFn, AvioSeekFunc seekFn, void *opaque,
+                                     int bufferSize = AVIO_SOURCE_MEM_IO_BUFFER )
+    {
+        AvioSource *s = new AvioSource(CALLBACK_SOURCE, -1);
+        s->m_read = readFn;
+        s->m_seek = seekFn;
+        s->m_opaque = opaque;
+        if (!s->allocContext(bufferSize, seekFn != NULL)) {
+            delete s;
+            return NULL;
+        }
+        return s;
+    }
+
+    AVIOContext *context() { return m_pb; }
+    Mode mode() const { return m_mode; }
+
+    // bytes delivered to AVIO so far, and the read() calls it took (FILE_SOURCE)
+    int64_t bytesRead() const { return m_bytesRead; }
+    long syscalls() const { return m_syscalls; }
+};
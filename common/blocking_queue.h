@@ -0,0 +1,104 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// A bounded FIFO between threads. push() blocks while the queue is full,
+// pop() blocks while it is empty. After close(), push() fails and pop()
+// drains what is left and then fails, which is how a producer signals the
+// end of the stream.
+template <typename T>
+class BlockingQueue{
+private:
+    std::deque<T> m_items;
+    std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    size_t m_capacity;
+    bool m_closed;
+private:
+    BlockingQueue( const BlockingQueue& q );
+    BlockingQueue& operator=( const BlockingQueue& q );
+public:
+    // capacity 0 means unbounded
+    explicit BlockingQueue( size_t capacity = 0 )
+        : m_capacity( capacity ), m_closed( false )
+    {
+    }
+
+    bool push( const T& item )
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notFull.wait(lock, [this](){ return m_closed || !m_capacity || m_items.size() < m_capacity; });
+            if (m_closed)
+                return false;
+            m_items.push_back(item);
+        }
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // non-blocking push, false when the queue is full or closed
+    bool tryPush( const T& item )
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed || (m_capacity && m_items.size() >= m_capacity))
+                return false;
+            m_items.push_back(item);
+        }
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    bool pop( T& item )
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notEmpty.wait(lock, [this](){ return m_closed || !m_items.empty(); });
+            if (m_items.empty())
+                return false;
+            item = m_items.front();
+            m_items.pop_front();
+        }
+        m_notFull.notify_one();
+        return true;
+    }
+
+    // non-blocking pop, false when nothing is queued right now
+    bool tryPop( T& item )
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_items.empty())
+                return false;
+            item = m_items.front();
+            m_items.pop_front();
+        }
+        m_notFull.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+    bool closed()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_closed;
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_items.size();
+    }
+};
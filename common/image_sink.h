@@ -0,0 +1,121 @@
+#pragma once
+/*
+ * 异步图片写入
+ * Asynchronous image sink.
+ *
+ * The caller takes a buffer from a fixed pool, assembles the whole file
+ * (header plus pixels) into it and commits it with a path. A writer pool
+ * then creates the file and stores it with a single write() call before
+ * giving the buffer back. When every buffer is in flight acquire() blocks,
+ * which is the backpressure that keeps memory bounded if the disk is slower
+ * than the producer.
+ */
+#include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "thread_pool.h"
+
+// A fixed set of equally sized buffers handed out and returned by pointer.
+class BufferPool{
+private:
+    std::vector<std::vector<uint8_t> > m_storage;
+    std::vector<uint8_t *> m_free;
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+    size_t m_bufferSize;
+private:
+    BufferPool( const BufferPool& bp );
+    BufferPool& operator=( const BufferPool& bp );
+public:
+    BufferPool( size_t bufferSize, int nbBuffers )
+        : m_storage( nbBuffers, std::vector<uint8_t>( bufferSize ) ), m_bufferSize( bufferSize )
+    {
+        for (int i = 0; i < nbBuffers; ++i)
+            m_free.push_back(m_storage[i].data());
+    }
+
+    size_t bufferSize() const { return m_bufferSize; }
+
+    uint8_t *acquire()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_released.wait(lock, [this](){ return !m_free.empty(); });
+        uint8_t *buf = m_free.back();
+        m_free.pop_back();
+        return buf;
+    }
+
+    void release( uint8_t *buf )
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free.push_back(buf);
+        }
+        m_released.notify_one();
+    }
+};
+
+class ImageSink{
+private:
+    BufferPool m_buffers;
+    ThreadPool m_writers;
+    std::atomic<int> m_errors;
+private:
+    ImageSink( const ImageSink& is );
+    ImageSink& operator=( const ImageSink& is );
+
+    void writeFile( const std::string& path, uint8_t *buf, size_t size )
+    {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "Could not open %s.\n", path.c_str());
+            ++m_errors;
+        } else {
+            size_t done = 0;
+            // one write() normally, loop only on a short write
+            while (done < size) {
+                ssize_t n = write(fd, buf + done, size - done);
+                if (n <= 0) {
+                    fprintf(stderr, "Could not write %s.\n", path.c_str());
+                    ++m_errors;
+                    break;
+                }
+                done += n;
+            }
+            close(fd);
+        }
+        m_buffers.release(buf);
+    }
+public:
+    // bufferSize must hold the largest complete file that will be committed
+    ImageSink( size_t bufferSize, int nbBuffers = 8, int nbWriters = 2 )
+        : m_buffers( bufferSize, nbBuffers ), m_writers( nbWriters ), m_errors( 0 )
+    {
+    }
+    ~ImageSink()
+    {
+        flush();
+    }
+
+    size_t bufferSize() const { return m_buffers.bufferSize(); }
+
+    // blocks while every buffer is still queued for writing
+    uint8_t *acquire() { return m_buffers.acquire(); }
+
+    // hands the first 'size' bytes of an acquired buffer to the writers
+    void commit( uint8_t *buf, size_t size, const std::string& path )
+    {
+        m_writers.submit([=](){ writeFile(path, buf, size); });
+    }
+
+    // waits until everything committed so far is on disk
+    void flush() { m_writers.wait(); }
+
+    int errors() const { return m_errors; }
+};
@@ -0,0 +1,347 @@
+#pragma once
+/*
+ * 关键帧索引（旁路文件）
+ * Keyframe index sidecar for fast random access.
+ *
+ * MPEG-TS has no index, so seeking in it means scanning. A KeyframeIndex
+ * records, for every stream with real GOPs, each keyframe's pts, dts, byte
+ * position and the length of the GOP it starts (in packets). It is filled
+ * from a read loop one packet at a time, saved next to the media file, and
+ * loaded again later to turn a seek into a binary search plus one byte
+ * seek.
+ *
+ * Streams where every packet is a keyframe (audio, subtitles, intra-only
+ * video) would need one entry per packet and gain nothing over a timestamp
+ * seek, so only their packet count is kept. A stream becomes a GOP stream
+ * at its first packet that is not a keyframe and is listed from the
+ * keyframe before it. Keyframes without any timestamp cannot be ordered
+ * and count as part of the previous GOP.
+ *
+ * Sidecar layout, little endian:
+ *   "KFI2", int64 file size, uint32 stream count, then per stream
+ *   int32 time base num, int32 time base den, uint32 keyframe count,
+ *   uint32 intra-only packet count (0 for a GOP stream), and per keyframe
+ *   int64 pts, int64 dts, int64 pos, uint32 gop length.
+ *
+ *   KeyframeIndex index;
+ *   AVFormatContext *ic = NULL;
+ *   KeyframeIndex::openInput("in.ts", NULL, &ic, index);
+ *   index.seek(ic, video_index, ts);
+ */
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "libavformat/avformat.h"
+#ifdef __cplusplus
+}
+#endif
+
+struct KeyframeEntry {
+    int64_t pts;            // stream time base, AV_NOPTS_VALUE if unknown
+    int64_t dts;
+    int64_t pos;            // byte offset of the packet, -1 if unknown
+    uint32_t gopLength;     // packets from this keyframe to the next one
+};
+
+class KeyframeIndex{
+private:
+    struct Stream {
+        AVRational timeBase;
+        std::vector<KeyframeEntry> keyframes;
+        KeyframeEntry last;     // latest keyframe while the stream is intra-only
+        uint32_t intraPackets;  // packets so far if every one was a keyframe
+        bool intra;
+        bool started;           // packets before the first keyframe are not counted
+    };
+    std::vector<Stream> m_streams;
+    int64_t m_fileSize;
+private:
+    KeyframeIndex( const KeyframeIndex& ki );
+    KeyframeIndex& operator=( const KeyframeIndex& ki );
+
+    static int64_t entryTime( const KeyframeEntry& e )
+    {
+        return e.pts != AV_NOPTS_VALUE ? e.pts : e.dts;
+    }
+
+    static void put32( std::vector<uint8_t>& b, uint32_t v )
+    {
+        for (int i = 0; i < 4; i++)
+            b.push_back((uint8_t)(v >> (8 * i)));
+    }
+
+    static void put64( std::vector<uint8_t>& b, uint64_t v )
+    {
+        for (int i = 0; i < 8; i++)
+            b.push_back((uint8_t)(v >> (8 * i)));
+    }
+
+    static uint32_t rd32( const uint8_t *b )
+    {
+        return b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+    }
+
+    static int64_t rd64( const uint8_t *b )
+    {
+        return (int64_t)((uint64_t)rd32(b + 4) << 32 | rd32(b));
+    }
+
+    static bool get32( FILE *f, uint32_t& v )
+    {
+        uint8_t b[4];
+        if (fread(b, 1, 4, f) != 4)
+            return false;
+        v = rd32(b);
+        return true;
+    }
+
+    static bool get64( FILE *f, int64_t& v )
+    {
+        uint8_t b[8];
+        if (fread(b, 1, 8, f) != 8)
+            return false;
+        v = rd64(b);
+        return true;
+    }
+
+    // bytes from the current position to the end of f, -1 if unknown
+    static int64_t bytesLeft( FILE *f )
+    {
+        long pos = ftell(f), end;
+        if (pos < 0 || fseek(f, 0, SEEK_END) < 0)
+            return -1;
+        end = ftell(f);
+        if (end < 0 || fseek(f, pos, SEEK_SET) < 0)
+            return -1;
+        return end - pos;
+    }
+
+    static int64_t inputSize( AVFormatContext *ic )
+    {
+        return ic->pb ? avio_size(ic->pb) : -1;
+    }
+public:
+    KeyframeIndex()
+        : m_fileSize( -1 )
+    {
+    }
+
+    // starts a new index for the streams of ic
+    void reset( AVFormatContext *ic )
+    {
+        m_streams.clear();
+        m_streams.resize(ic->nb_streams);
+        for (unsigned i = 0; i < ic->nb_streams; i++) {
+            m_streams[i].timeBase = ic->streams[i]->time_base;
+            m_streams[i].intraPackets = 0;
+            m_streams[i].intra = true;
+            m_streams[i].started = false;
+        }
+        m_fileSize = inputSize(ic);
+    }
+
+    // call for every packet av_read_frame returns, in order
+    void addPacket( const AVPacket *pkt )
+    {
+        Stream *s;
+        bool key;
+        if (pkt->stream_index < 0 || pkt->stream_index >= (int)m_streams.size())
+            return;
+        s = &m_streams[pkt->stream_index];
+        key = pkt->flags & AV_PKT_FLAG_KEY;
+        if (key && (pkt->pts != AV_NOPTS_VALUE || pkt->dts != AV_NOPTS_VALUE)) {
+            KeyframeEntry e;
+            e.pts = pkt->pts;
+            e.dts = pkt->dts;
+            e.pos = pkt->pos;
+            e.gopLength = 1;
+            if (s->intra) {
+                s->last = e;
+                s->intraPackets++;
+            } else {
+                s->keyframes.push_back(e);
+            }
+            s->started = true;
+            return;
+        }
+        if (!s->started)
+            return;
+        if (s->intra) {
+            if (key) {
+                s->intraPackets++;
+                return;
+            }
+            // the first packet that is not a keyframe: the stream has GOPs
+            s->intra = false;
+            s->intraPackets = 0;
+            s->keyframes.push_back(s->last);
+        }
+        s->keyframes.back().gopLength++;
+    }
+
+    bool save( const char *path ) const
+    {
+        std::vector<uint8_t> b;
+        FILE *f;
+        bool ok;
+
+        b.insert(b.end(), "KFI2", "KFI2" + 4);
+        put64(b, m_fileSize);
+        put32(b, m_streams.size());
+        for (size_t i = 0; i < m_streams.size(); i++) {
+            const Stream& s = m_streams[i];
+            put32(b, s.timeBase.num);
+            put32(b, s.timeBase.den);
+            put32(b, s.keyframes.size());
+            put32(b, s.intra ? s.intraPackets : 0);
+            for (size_t j = 0; j < s.keyframes.size(); j++) {
+                put64(b, s.keyframes[j].pts);
+                put64(b, s.keyframes[j].dts);
+                put64(b, s.keyframes[j].pos);
+                put32(b, s.keyframes[j].gopLength);
+            }
+        }
+        f = fopen(path, "wb");
+        if (!f)
+            return false;
+        ok = fwrite(b.data(), 1, b.size(), f) == b.size();
+        return fclose(f) == 0 && ok;
+    }
+
+    /* Loads the keyframes of every stream, or only those of stream if it is
+     * not negative; the other streams keep just their time base. Counts are
+     * checked against the bytes left in the file before anything is
+     * allocated, so a truncated or corrupted sidecar just fails to load. */
+    bool load( const char *path, int stream = -1 )
+    {
+        FILE *f = fopen(path, "rb");
+        std::vector<uint8_t> buf;
+        char magic[4];
+        uint32_t nb, n, num, den, intra;
+        bool ok = false;
+
+        if (!f)
+            return false;
+        m_streams.clear();
+        if (fread(magic, 1, 4, f) != 4 || memcmp(magic, "KFI2", 4) || !get64(f, m_fileSize) || !get32(f, nb))
+            goto end;
+        // every stream takes at least its 16 byte header
+        if ((int64_t)nb * 16 > bytesLeft(f))
+            goto end;
+        m_streams.resize(nb);
+        for (uint32_t i = 0; i < nb; i++) {
+            Stream& s = m_streams[i];
+            if (!get32(f, num) || !get32(f, den) || !get32(f, n) || !get32(f, intra))
+                goto end;
+            // 28 bytes per keyframe: pts, dts, pos and gop length
+            if ((int64_t)n * 28 > bytesLeft(f))
+                goto end;
+            s.timeBase.num = (int)num;
+            s.timeBase.den = (int)den;
+            s.intraPackets = intra;
+            s.intra = n == 0;
+            s.started = n > 0;
+            if (stream >= 0 && (int)i != stream) {
+                if (fseek(f, (long)n * 28, SEEK_CUR) < 0)
+                    goto end;
+                continue;
+            }
+            buf.resize((size_t)n * 28);
+            if (n && fread(buf.data(), 1, buf.size(), f) != buf.size())
+                goto end;
+            s.keyframes.resize(n);
+            for (uint32_t j = 0; j < n; j++) {
+                const uint8_t *b = buf.data() + (size_t)j * 28;
+                KeyframeEntry& e = s.keyframes[j];
+                e.pts = rd64(b);
+                e.dts = rd64(b + 8);
+                e.pos = rd64(b + 16);
+                e.gopLength = rd32(b + 24);
+            }
+        }
+        ok = true;
+end:
+        fclose(f);
+        if (!ok)
+            m_streams.clear();
+        return ok;
+    }
+
+    // false if the index was built from a different version of the file
+    bool matches( AVFormatContext *ic ) const
+    {
+        if (m_streams.size() != ic->nb_streams || m_fileSize != inputSize(ic))
+            return false;
+        for (unsigned i = 0; i < ic->nb_streams; i++) {
+            if (av_cmp_q(m_streams[i].timeBase, ic->streams[i]->time_base))
+                return false;
+        }
+        return true;
+    }
+
+    int streams() const { return (int)m_streams.size(); }
+    const std::vector<KeyframeEntry>& keyframes( int stream ) const { return m_streams[stream].keyframes; }
+    // packets of a stream where every packet is a keyframe, 0 for a GOP stream
+    uint32_t intraPackets( int stream ) const { return m_streams[stream].intra ? m_streams[stream].intraPackets : 0; }
+
+    /* The last keyframe at or before ts (stream time base), the first one if
+     * ts is before all of them, NULL if the stream has none listed. */
+    const KeyframeEntry *find( int stream, int64_t ts ) const
+    {
+        const std::vector<KeyframeEntry>& k = m_streams[stream].keyframes;
+        size_t lo = 0, hi = k.size();
+        if (k.empty())
+            return NULL;
+        // first entry after ts
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (entryTime(k[mid]) <= ts)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return &k[lo ? lo - 1 : 0];
+    }
+
+    /* Positions ic on the keyframe at or before ts with a byte seek. Falls
+     * back to a timestamp seek when the stream has no byte positions. */
+    int seek( AVFormatContext *ic, int stream, int64_t ts ) const
+    {
+        const KeyframeEntry *e = stream < (int)m_streams.size() ? find(stream, ts) : NULL;
+        if (!e || e->pos < 0)
+            return av_seek_frame(ic, stream, ts, AVSEEK_FLAG_BACKWARD);
+        return av_seek_frame(ic, stream, e->pos, AVSEEK_FLAG_BYTE);
+    }
+
+    // the sidecar that goes with a media file
+    static std::string sidecarName( const char *filename )
+    {
+        return std::string(filename) + ".kfi";
+    }
+
+    /* Opens filename and loads its sidecar (sidecarName() if sidecar is
+     * NULL). A missing or stale sidecar is not an error: the index is then
+     * empty and seek() uses timestamp seeks. */
+    static int openInput( const char *filename, const char *sidecar, AVFormatContext **ic, KeyframeIndex& index )
+    {
+        std::string name = sidecar ? std::string(sidecar) : sidecarName(filename);
+        int ret;
+
+        if ((ret = avformat_open_input(ic, filename, NULL, NULL)) < 0)
+            return ret;
+        if ((ret = avformat_find_stream_info(*ic, NULL)) < 0) {
+            avformat_close_input(ic);
+            return ret;
+        }
+        if (!index.load(name.c_str()) || !index.matches(*ic))
+            index.reset(*ic);
+        return 0;
+    }
+};
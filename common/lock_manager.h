@@ -0,0 +1,45 @@
+#pragma once
+/*
+ * libavcodec 锁管理器
+ * A std::mutex lock manager for libavcodec.
+ *
+ * avcodec_open2() and avcodec_close() are only safe to call from several
+ * threads at once (avformat_find_stream_info() opens decoders too) when
+ * a lock manager is registered. Register it before the threads start
+ * and unregister it once they have all finished:
+ *
+ *   if (av_lockmgr_register(mutex_lock_manager) < 0)
+ *       ...
+ *   ... worker threads open and close codecs ...
+ *   av_lockmgr_register(NULL);
+ */
+#include <mutex>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "libavcodec/avcodec.h"
+#ifdef __cplusplus
+};
+#endif
+
+static inline int mutex_lock_manager(void **mutex, enum AVLockOp op)
+{
+    switch (op) {
+        case AV_LOCK_CREATE:
+            *mutex = new std::mutex();
+            break;
+        case AV_LOCK_OBTAIN:
+            ((std::mutex *)*mutex)->lock();
+            break;
+        case AV_LOCK_RELEASE:
+            ((std::mutex *)*mutex)->unlock();
+            break;
+        case AV_LOCK_DESTROY:
+            delete (std::mutex *)*mutex;
+            *mutex = NULL;
+            break;
+    }
+    return 0;
+}
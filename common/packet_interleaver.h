@@ -0,0 +1,244 @@
+#pragma once
+/*
+ * 有内存上限的交织器
+ * Packet interleaver with a hard memory budget.
+ *
+ * Producers (one per stream, usually an encoder thread) push packets in
+ * dts order; the muxer pops them in global dts order and writes them with
+ * av_write_frame, so nothing else buffers packets behind its back.
+ *
+ * Normally a packet is only handed out once every running stream has a
+ * packet queued, which is what makes the order exact. Two limits break
+ * that wait:
+ *   - max delta: the queued packets span more than maxDelta microseconds,
+ *     a stream has stalled or has a long B-frame delay;
+ *   - budget: the queued packets use more than memoryBudget bytes.
+ * Either way the oldest packet is written anyway. A producer whose stream
+ * already has packets queued blocks while the budget is exceeded; a
+ * producer with an empty queue never blocks, because the muxer may be
+ * waiting for exactly that packet, so the memory in use stays below the
+ * budget plus one packet per stream.
+ *
+ *   PacketInterleaver il(nb_streams, 16 << 20, 1000000);
+ *   il.setTimeBase(i, st->time_base);      // for every stream
+ *   producers: il.push(i, pkt) ... il.finish(i);
+ *   muxer:     while ((pkt = il.pop())) { av_write_frame(oc, pkt); ... }
+ */
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "libavcodec/avcodec.h"
+#include "libavutil/mathematics.h"
+#include "libavutil/time.h"
+#ifdef __cplusplus
+}
+#endif
+
+struct InterleaverStreamStats {
+    long packets;
+    size_t maxDepth;        // packets queued at once
+    int64_t pushWait;       // us the producer was blocked by the budget
+    int64_t stallWait;      // us the muxer waited for this stream
+};
+
+class PacketInterleaver{
+private:
+    struct Stream {
+        std::deque<AVPacket *> queue;
+        AVRational timeBase;
+        bool finished;
+        InterleaverStreamStats stats;
+    };
+    std::vector<Stream> m_streams;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    size_t m_budget, m_bytes, m_peakBytes;
+    int64_t m_maxDelta;
+    long m_forcedDelta, m_forcedBudget;
+    int m_blocked;          // producers waiting for the budget
+    bool m_aborted;
+private:
+    PacketInterleaver( const PacketInterleaver& pi );
+    PacketInterleaver& operator=( const PacketInterleaver& pi );
+
+    static size_t packetBytes( const AVPacket *pkt )
+    {
+        return sizeof(*pkt) + pkt->size;
+    }
+
+    int64_t headTime( const Stream& s ) const
+    {
+        const AVPacket *pkt = s.queue.front();
+        int64_t t = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+        return av_rescale_q(t, s.timeBase, AV_TIME_BASE_Q);
+    }
+public:
+    PacketInterleaver( int nbStreams, size_t memoryBudget, int64_t maxDelta )
+        : m_streams( nbStreams ), m_budget( memoryBudget ), m_bytes( 0 ), m_peakBytes( 0 ),
+          m_maxDelta( maxDelta ), m_forcedDelta( 0 ), m_forcedBudget( 0 ), m_blocked( 0 ), m_aborted( false )
+    {
+        for (int i = 0; i < nbStreams; i++) {
+            m_streams[i].timeBase = AV_TIME_BASE_Q;
+            m_streams[i].finished = false;
+            m_streams[i].stats = InterleaverStreamStats();
+        }
+    }
+    ~PacketInterleaver()
+    {
+        for (size_t i = 0; i < m_streams.size(); i++) {
+            for (size_t j = 0; j < m_streams[i].queue.size(); j++) {
+                av_free_packet(m_streams[i].queue[j]);
+                av_free(m_streams[i].queue[j]);
+            }
+        }
+    }
+
+    // the time base the stream's packet timestamps are in
+    void setTimeBase( int stream, AVRational tb ) { m_streams[stream].timeBase = tb; }
+
+    /* Takes ownership of an av_malloc'ed packet. Returns false, with the
+     * packet freed, when the interleaver was aborted. */
+    bool push( int stream, AVPacket *pkt )
+    {
+        Stream& s = m_streams[stream];
+        size_t size = packetBytes(pkt);
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_bytes + size > m_budget && !s.queue.empty() && !m_aborted) {
+                int64_t t0 = av_gettime_relative();
+                m_blocked++;
+                m_changed.notify_all();
+                m_changed.wait(lock, [&]() { return m_aborted || s.queue.empty() || m_bytes + size <= m_budget; });
+                m_blocked--;
+                s.stats.pushWait += av_gettime_relative() - t0;
+            }
+            if (!m_aborted) {
+                s.queue.push_back(pkt);
+                s.stats.packets++;
+                if (s.queue.size() > s.stats.maxDepth)
+                    s.stats.maxDepth = s.queue.size();
+                m_bytes += size;
+                if (m_bytes > m_peakBytes)
+                    m_peakBytes = m_bytes;
+                pkt = NULL;
+            }
+        }
+        m_changed.notify_all();
+        if (pkt) {
+            av_free_packet(pkt);
+            av_free(pkt);
+            return false;
+        }
+        return true;
+    }
+
+    // no more packets will come for this stream
+    void finish( int stream )
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_streams[stream].finished = true;
+        }
+        m_changed.notify_all();
+    }
+
+    // wakes everybody up and makes push() and pop() fail from now on
+    void abort()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_aborted = true;
+        }
+        m_changed.notify_all();
+    }
+
+    /* The next packet to write, NULL once every stream has finished and
+     * everything was handed out. The caller owns the packet. */
+    AVPacket *pop()
+    {
+        AVPacket *pkt = NULL;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (!m_aborted) {
+                int best = -1;
+                int64_t oldest = 0, newest = 0;
+                bool complete = true, any = false;
+
+                for (size_t i = 0; i < m_streams.size(); i++) {
+                    const Stream& s = m_streams[i];
+                    if (s.queue.empty()) {
+                        if (!s.finished)
+                            complete = false;
+                        continue;
+                    }
+                    int64_t t = headTime(s);
+                    int64_t last = av_rescale_q(s.queue.back()->dts != AV_NOPTS_VALUE ? s.queue.back()->dts
+                                                                                     : s.queue.back()->pts,
+                                                s.timeBase, AV_TIME_BASE_Q);
+                    if (!any || t < oldest) {
+                        oldest = t;
+                        best = (int)i;
+                    }
+                    if (!any || last > newest)
+                        newest = last;
+                    any = true;
+                }
+
+                if (best >= 0 && !complete) {
+                    if (newest - oldest > m_maxDelta)
+                        m_forcedDelta++;
+                    else if (m_blocked || m_bytes >= m_budget)
+                        m_forcedBudget++;
+                    else
+                        best = -1;
+                }
+                if (best >= 0) {
+                    Stream& s = m_streams[best];
+                    pkt = s.queue.front();
+                    s.queue.pop_front();
+                    m_bytes -= packetBytes(pkt);
+                    break;
+                }
+                if (complete)
+                    break;      // nothing queued and nothing more to come
+
+                // charge the wait to the streams we are waiting for
+                int64_t t0 = av_gettime_relative();
+                m_changed.wait(lock);
+                int64_t waited = av_gettime_relative() - t0;
+                for (size_t i = 0; i < m_streams.size(); i++) {
+                    if (m_streams[i].queue.empty() && !m_streams[i].finished)
+                        m_streams[i].stats.stallWait += waited;
+                }
+            }
+        }
+        if (pkt)
+            m_changed.notify_all();
+        return pkt;
+    }
+
+    const InterleaverStreamStats& stats( int stream ) const { return m_streams[stream].stats; }
+    size_t peakBytes() const { return m_peakBytes; }
+    long forcedByDelta() const { return m_forcedDelta; }
+    long forcedByBudget() const { return m_forcedBudget; }
+
+    void printStats( FILE *f )
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        fprintf(f, "Interleaver: peak %.1f KB of %.1f KB, %ld packets forced by max delta, %ld by budget\n",
+                m_peakBytes / 1024.0, m_budget / 1024.0, m_forcedDelta, m_forcedBudget);
+        for (size_t i = 0; i < m_streams.size(); i++) {
+            const InterleaverStreamStats& st = m_streams[i].stats;
+            fprintf(f, "  stream %d: %ld packets, max depth %d, producer blocked %.1f ms, muxer waited %.1f ms\n",
+                    (int)i, st.packets, (int)st.maxDepth, st.pushWait / 1000.0, st.stallWait / 1000.0);
+        }
+    }
+};
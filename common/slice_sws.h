@@ -0,0 +1,313 @@
+#pragma once
+/*
+ * 多线程切片版本的 sws_scale
+ * Slice-parallel colour conversion on top of libswscale.
+ *
+ * The picture is cut into horizontal bands and every band is converted by
+ * its own SwsContext on a ThreadPool. Each band context sees a few extra
+ * source rows above and below (the margin) so that the vertical filter taps
+ * read the same neighbours as a whole-frame conversion; the margin rows are
+ * converted into a scratch picture and only the band interior is copied to
+ * the destination. On the libswscale path the result is identical to a
+ * single sws_scale call; the yuv2rgb.h fast path below is not bit-exact.
+ *
+ * Bands are only used when the vertical size is unchanged (pure colour
+ * conversion or horizontal-only scaling), otherwise the filter phase would
+ * differ per band; in that case a single whole-frame context is used.
+ *
+ * The band contexts come from the process wide SwsContextCache, so opening
+ * a second file with the same geometry and colorspace does not recompute
+ * the filters.
+ *
+ * Same-size YUV420P/YUVJ420P to RGB24 does not use libswscale at all but
+ * the SIMD converter from yuv2rgb.h, which matches swscale's unscaled path
+ * within a small rounding difference. Pass SWS_ACCURATE_RND or
+ * SWS_BITEXACT to keep the libswscale output.
+ *
+ * Usage mirrors libswscale:
+ *   SliceSwsContext *c = slice_sws_getContext(...);
+ *   slice_sws_scale(c, src, src_linesize, dst, dst_linesize);
+ *   slice_sws_freeContext(c);
+ */
+#include <vector>
+#include "thread_pool.h"
+#include "sws_cache.h"
+#include "yuv2rgb.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "libavutil/imgutils.h"
+#include "libavutil/pixdesc.h"
+#include "libswscale/swscale.h"
+#ifdef __cplusplus
+}
+#endif
+
+// band boundaries are aligned to this many rows, which keeps chroma
+// subsampling and ordered dither phase identical to the whole frame
+#define SLICE_SWS_ALIGN      16
+// bands smaller than this are not worth a thread
+#define SLICE_SWS_MIN_ROWS   64
+
+struct SliceSwsBand {
+    int y0, y1;             // rows of the picture this band is responsible for
+    int r0, r1;             // rows actually converted (band plus margin)
+    struct SwsContext *ctx;
+    uint8_t *scratch[4];    // NULL when the band writes straight into dst
+    int scratch_linesize[4];
+};
+
+struct SliceSwsContext {
+    int srcW, srcH, dstW, dstH;
+    enum AVPixelFormat srcFormat, dstFormat;
+    int flags;
+    int colorspace, srcRange;   // as in SwsCacheKey, -1 for the defaults
+    std::vector<SliceSwsBand> bands;
+    ThreadPool *pool;
+    // set when the dedicated YUV420P -> RGB24 converter replaces swscale
+    Yuv2RgbRowFunc yuv2rgb;
+    Yuv2RgbMatrix matrix;
+};
+
+/* rows of margin needed on each side of a band for the given scaler */
+static inline int slice_sws_margin(int flags)
+{
+    if (flags & (SWS_FAST_BILINEAR | SWS_POINT | SWS_BILINEAR | SWS_X | SWS_AREA))
+        return 16;
+    if (flags & (SWS_BICUBIC | SWS_BICUBLIN))
+        return 32;
+    return 48; // gauss, sinc, lanczos, spline
+}
+
+static inline int slice_sws_plane_rows(enum AVPixelFormat fmt, int plane, int rows)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+    if (plane == 1 || plane == 2)
+        return -((-rows) >> desc->log2_chroma_h);
+    return rows;
+}
+
+/* whether a band split gives the same bytes as a whole-frame conversion */
+static inline bool slice_sws_can_split(int srcH, enum AVPixelFormat srcFormat,
+                                       int dstH, enum AVPixelFormat dstFormat, int flags)
+{
+    const AVPixFmtDescriptor *src_desc = av_pix_fmt_desc_get(srcFormat);
+    const AVPixFmtDescriptor *dst_desc = av_pix_fmt_desc_get(dstFormat);
+    if (!src_desc || !dst_desc)
+        return false;
+    // a different height changes the vertical filter phase per band
+    if (srcH != dstH || (srcH & 1))
+        return false;
+    // paletted input keeps its palette in data[1], error diffusion carries
+    // state from row to row
+    if (src_desc->flags & AV_PIX_FMT_FLAG_PAL || flags & SWS_ERROR_DIFFUSION)
+        return false;
+    // low depth RGB output may use error diffusion dithering
+    if ((dst_desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL)) &&
+        av_get_bits_per_pixel(dst_desc) < 24)
+        return false;
+    return true;
+}
+
+/* whether the conversion can go through yuv420p_to_rgb24 */
+static inline bool slice_sws_use_yuv2rgb(int srcW, int srcH, enum AVPixelFormat srcFormat,
+                                         int dstW, int dstH, enum AVPixelFormat dstFormat, int flags)
+{
+    return (srcFormat == AV_PIX_FMT_YUV420P || srcFormat == AV_PIX_FMT_YUVJ420P) &&
+           dstFormat == AV_PIX_FMT_RGB24 && srcW == dstW && srcH == dstH &&
+           !(flags & (SWS_ACCURATE_RND | SWS_BITEXACT | SWS_FULL_CHR_H_INT | SWS_FULL_CHR_H_INP));
+}
+
+static inline void slice_sws_freeContext(SliceSwsContext *c)
+{
+    if (!c)
+        return;
+    delete c->pool;
+    for (size_t i = 0; i < c->bands.size(); ++i) {
+        sws_cache_releaseContext(c->bands[i].ctx);
+        av_freep(&c->bands[i].scratch[0]);
+    }
+    delete c;
+}
+
+/* checks out the context for band rows r0..r1, or the whole frame */
+static inline struct SwsContext *slice_sws_bandContext(SliceSwsContext *c, const SliceSwsBand *band,
+                                                        int colorspace, int srcRange)
+{
+    if (band->r0 == 0 && band->r1 == c->srcH)
+        return sws_cache_getContext(c->srcW, c->srcH, c->srcFormat, c->dstW, c->dstH, c->dstFormat,
+                                    c->flags, colorspace, srcRange);
+    return sws_cache_getContext(c->srcW, band->r1 - band->r0, c->srcFormat,
+                                c->dstW, band->r1 - band->r0, c->dstFormat,
+                                c->flags, colorspace, srcRange);
+}
+
+/*
+ * nb_threads <= 0 uses one band per core. Returns NULL if any of the
+ * underlying SwsContexts cannot be created.
+ */
+static inline SliceSwsContext *slice_sws_getContext(int srcW, int srcH, enum AVPixelFormat srcFormat,
+                                                    int dstW, int dstH, enum AVPixelFormat dstFormat,
+                                                    int flags, int nb_threads)
+{
+    SliceSwsContext *c = new SliceSwsContext();
+    int nb_bands = 1;
+    int band_rows, margin, i;
+
+    c->srcW = srcW; c->srcH = srcH; c->srcFormat = srcFormat;
+    c->dstW = dstW; c->dstH = dstH; c->dstFormat = dstFormat;
+    c->flags = flags;
+    c->colorspace = c->srcRange = -1;
+    c->pool = NULL;
+    c->yuv2rgb = NULL;
+    if (slice_sws_use_yuv2rgb(srcW, srcH, srcFormat, dstW, dstH, dstFormat, flags)) {
+        c->yuv2rgb = yuv2rgb_get_row_func(av_get_cpu_flags());
+        // same defaults as swscale: BT.601, JPEG formats are full range
+        c->matrix = yuv2rgb_matrix(0, srcFormat == AV_PIX_FMT_YUVJ420P);
+    }
+
+    if (nb_threads <= 0)
+        nb_threads = ThreadPool::defaultThreadCount();
+    if (c->yuv2rgb) {
+        // rows are independent, no margin needed
+        nb_bands = FFMAX(1, FFMIN(nb_threads, srcH / SLICE_SWS_MIN_ROWS));
+    } else if (slice_sws_can_split(srcH, srcFormat, dstH, dstFormat, flags)) {
+        nb_bands = srcH / SLICE_SWS_MIN_ROWS;
+        if (nb_bands > nb_threads)
+            nb_bands = nb_threads;
+        if (nb_bands < 1)
+            nb_bands = 1;
+    }
+
+    band_rows = (srcH + nb_bands - 1) / nb_bands;
+    band_rows = (band_rows + SLICE_SWS_ALIGN - 1) / SLICE_SWS_ALIGN * SLICE_SWS_ALIGN;
+    margin    = slice_sws_margin(flags);
+
+    for (i = 0; i * band_rows < srcH; ++i) {
+        SliceSwsBand band = { 0 };
+        band.y0 = i * band_rows;
+        band.y1 = FFMIN(srcH, band.y0 + band_rows);
+        if (c->yuv2rgb) {
+            band.r0 = band.y0;
+            band.r1 = band.y1;
+            c->bands.push_back(band);
+            continue;
+        } else if (band.y0 == 0 && band.y1 == srcH) {
+            // whole frame, no margin and no scratch needed
+            band.r0 = 0;
+            band.r1 = srcH;
+            band.ctx = slice_sws_bandContext(c, &band, -1, -1);
+        } else {
+            band.r0 = FFMAX(0, band.y0 - margin);
+            band.r1 = FFMIN(srcH, band.y1 + margin);
+            band.ctx = slice_sws_bandContext(c, &band, -1, -1);
+            if (band.ctx && av_image_alloc(band.scratch, band.scratch_linesize,
+                                           dstW, band.r1 - band.r0, dstFormat, 16) < 0) {
+                sws_cache_releaseContext(band.ctx);
+                band.ctx = NULL;
+            }
+        }
+        c->bands.push_back(band);
+        if (!band.ctx) {
+            av_log(NULL, AV_LOG_ERROR,
+                   "Could not create the band scaler for rows %d-%d\n", band.y0, band.y1);
+            slice_sws_freeContext(c);
+            return NULL;
+        }
+    }
+
+    if (c->bands.size() > 1)
+        c->pool = new ThreadPool((int)c->bands.size());
+    return c;
+}
+
+static inline void slice_sws_scale_band(SliceSwsContext *c, SliceSwsBand *band,
+                                        const uint8_t *const src[], const int srcStride[],
+                                        uint8_t *const dst[], const int dstStride[])
+{
+    const uint8_t *band_src[4] = { NULL };
+    int nb_src_planes = av_pix_fmt_count_planes(c->srcFormat);
+    int nb_dst_planes = av_pix_fmt_count_planes(c->dstFormat);
+    int p;
+
+    if (c->yuv2rgb) {
+        yuv420p_to_rgb24(c->yuv2rgb, src, srcStride, dst[0], dstStride[0],
+                         c->dstW, band->y0, band->y1, &c->matrix);
+        return;
+    }
+    if (!band->scratch[0]) {
+        sws_scale(band->ctx, src, srcStride, 0, c->srcH, dst, dstStride);
+        return;
+    }
+
+    for (p = 0; p < nb_src_planes; ++p)
+        band_src[p] = src[p] + slice_sws_plane_rows(c->srcFormat, p, band->r0) * srcStride[p];
+    sws_scale(band->ctx, band_src, srcStride, 0, band->r1 - band->r0,
+              band->scratch, band->scratch_linesize);
+
+    // keep only the interior, the margin rows belong to the neighbours
+    for (p = 0; p < nb_dst_planes; ++p) {
+        int skip = slice_sws_plane_rows(c->dstFormat, p, band->y0 - band->r0);
+        int rows = slice_sws_plane_rows(c->dstFormat, p, band->y1 - band->y0);
+        int y0   = slice_sws_plane_rows(c->dstFormat, p, band->y0);
+        av_image_copy_plane(dst[p] + y0 * dstStride[p], dstStride[p],
+                            band->scratch[p] + skip * band->scratch_linesize[p],
+                            band->scratch_linesize[p],
+                            av_image_get_linesize(c->dstFormat, c->dstW, p), rows);
+    }
+}
+
+/* Convert one whole picture; returns the height of the output. */
+static inline int slice_sws_scale(SliceSwsContext *c,
+                                  const uint8_t *const src[], const int srcStride[],
+                                  uint8_t *const dst[], const int dstStride[])
+{
+    if (!c->pool) {
+        slice_sws_scale_band(c, &c->bands[0], src, srcStride, dst, dstStride);
+        return c->dstH;
+    }
+    for (size_t i = 0; i < c->bands.size(); ++i) {
+        SliceSwsBand *band = &c->bands[i];
+        c->pool->submit([=](){ slice_sws_scale_band(c, band, src, srcStride, dst, dstStride); });
+    }
+    c->pool->wait();
+    return c->dstH;
+}
+
+/*
+ * Set the source colour matrix (SWS_CS_ITU601, SWS_CS_ITU709, ...) and
+ * range (1 for full/JPEG range), e.g. from the decoder's colorspace and
+ * color_range. Call before the first slice_sws_scale. The band contexts
+ * are swapped for cached ones with these settings, so the next file with
+ * the same colorspace reuses them.
+ */
+static inline int slice_sws_setColorspace(SliceSwsContext *c, int colorspace, int full_range)
+{
+    std::vector<struct SwsContext *> ctxs(c->bands.size(), (struct SwsContext *)NULL);
+    size_t i;
+
+    if (c->yuv2rgb) {
+        c->matrix = yuv2rgb_matrix(colorspace == SWS_CS_ITU709, full_range);
+        return 0;
+    }
+    if (colorspace == c->colorspace && full_range == c->srcRange)
+        return 0;
+    for (i = 0; i < c->bands.size(); ++i) {
+        ctxs[i] = slice_sws_bandContext(c, &c->bands[i], colorspace, full_range);
+        if (!ctxs[i]) {
+            // keep the old contexts, the new ones go back unused
+            while (i-- > 0)
+                sws_cache_releaseContext(ctxs[i]);
+            return AVERROR(EINVAL);
+        }
+    }
+    for (i = 0; i < c->bands.size(); ++i) {
+        sws_cache_releaseContext(c->bands[i].ctx);
+        c->bands[i].ctx = ctxs[i];
+    }
+    c->colorspace = colorspace;
+    c->srcRange = full_range;
+    return 0;
+}
@@ -0,0 +1,217 @@
+#pragma once
+/*
+ * SwsContext 缓存
+ * Process wide cache of scaler contexts.
+ *
+ * sws_getContext spends most of its time computing filter coefficients,
+ * which only depend on the conversion parameters. When many files with the
+ * same geometry are processed in one process, a context released by one
+ * file is handed to the next one instead of being rebuilt.
+ *
+ * A context is checked out exclusively: two threads asking for the same
+ * parameters at the same time get two different contexts, and a context
+ * only becomes shareable again once it is released. Released contexts are
+ * kept in LRU order and the least recently used ones are freed when more
+ * than capacity() of them are idle. The source colour matrix and range are
+ * part of the key: files with the same geometry and colorspace reuse each
+ * other's contexts, and switching to another colorspace checks out a
+ * different context instead of forcing a discard. Any other change made
+ * after checkout must be given back with sws_cache_discardContext so that
+ * nobody else inherits it.
+ *
+ *   struct SwsContext *ctx = sws_cache_getContext(...same as sws_getContext...);
+ *   sws_scale(ctx, ...);
+ *   sws_cache_releaseContext(ctx);
+ */
+#include <list>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "libswscale/swscale.h"
+#ifdef __cplusplus
+}
+#endif
+
+#define SWS_CACHE_DEFAULT_CAPACITY 32
+
+struct SwsCacheKey {
+    int srcW, srcH, srcFormat;
+    int dstW, dstH, dstFormat;
+    int flags;
+    int colorspace;         // SWS_CS_*, -1 keeps what sws_getContext picks
+    int srcRange;           // 1 for full/JPEG range, -1 keeps the default
+
+    bool operator==( const SwsCacheKey& o ) const
+    {
+        return srcW == o.srcW && srcH == o.srcH && srcFormat == o.srcFormat &&
+               dstW == o.dstW && dstH == o.dstH && dstFormat == o.dstFormat &&
+               flags == o.flags && colorspace == o.colorspace && srcRange == o.srcRange;
+    }
+};
+
+class SwsContextCache{
+private:
+    typedef std::pair<SwsCacheKey, struct SwsContext *> Entry;
+    // idle contexts, most recently released first
+    std::list<Entry> m_idle;
+    std::map<struct SwsContext *, SwsCacheKey> m_checkedOut;
+    std::mutex m_mutex;
+    size_t m_capacity;
+    std::atomic<long> m_hits, m_misses, m_evictions;
+private:
+    SwsContextCache( const SwsContextCache& c );
+    SwsContextCache& operator=( const SwsContextCache& c );
+
+    static bool applyColorspace( struct SwsContext *ctx, const SwsCacheKey& key )
+    {
+        int *inv_table, *table;
+        int src_range, dst_range, brightness, contrast, saturation;
+        if (key.colorspace < 0 && key.srcRange < 0)
+            return true;
+        if (sws_getColorspaceDetails(ctx, &inv_table, &src_range, &table, &dst_range,
+                                     &brightness, &contrast, &saturation) < 0)
+            return false;
+        if (key.colorspace >= 0)
+            inv_table = (int *)sws_getCoefficients(key.colorspace);
+        if (key.srcRange >= 0)
+            src_range = key.srcRange;
+        return sws_setColorspaceDetails(ctx, inv_table, src_range, table, dst_range,
+                                        brightness, contrast, saturation) >= 0;
+    }
+public:
+    explicit SwsContextCache( size_t capacity = SWS_CACHE_DEFAULT_CAPACITY )
+        : m_capacity( capacity ), m_hits( 0 ), m_misses( 0 ), m_evictions( 0 )
+    {
+    }
+    ~SwsContextCache()
+    {
+        for (std::list<Entry>::iterator it = m_idle.begin(); it != m_idle.end(); ++it)
+            sws_freeContext(it->second);
+    }
+
+    static SwsContextCache& instance()
+    {
+        static SwsContextCache cache;
+        return cache;
+    }
+
+    struct SwsContext *checkout( const SwsCacheKey& key )
+    {
+        struct SwsContext *ctx = NULL;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (std::list<Entry>::iterator it = m_idle.begin(); it != m_idle.end(); ++it) {
+                if (it->first == key) {
+                    ctx = it->second;
+                    m_idle.erase(it);
+                    m_checkedOut[ctx] = key;
+                    break;
+                }
+            }
+        }
+        if (ctx) {
+            ++m_hits;
+            return ctx;
+        }
+
+        // build outside the lock, this is the slow part
+        ++m_misses;
+        ctx = sws_getContext(key.srcW, key.srcH, (enum AVPixelFormat)key.srcFormat,
+                             key.dstW, key.dstH, (enum AVPixelFormat)key.dstFormat,
+                             key.flags, NULL, NULL, NULL);
+        if (ctx && !applyColorspace(ctx, key)) {
+            sws_freeContext(ctx);
+            ctx = NULL;
+        }
+        if (ctx) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_checkedOut[ctx] = key;
+        }
+        return ctx;
+    }
+
+    void checkin( struct SwsContext *ctx )
+    {
+        struct SwsContext *evicted = NULL;
+        if (!ctx)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::map<struct SwsContext *, SwsCacheKey>::iterator it = m_checkedOut.find(ctx);
+            if (it == m_checkedOut.end()) {
+                // not ours, nothing to remember it by
+                evicted = ctx;
+            } else {
+                m_idle.push_front(Entry(it->second, ctx));
+                m_checkedOut.erase(it);
+                if (m_idle.size() > m_capacity) {
+                    evicted = m_idle.back().second;
+                    m_idle.pop_back();
+                    ++m_evictions;
+                }
+            }
+        }
+        sws_freeContext(evicted);
+    }
+
+    // forget a checked out context and free it instead of caching it
+    void discard( struct SwsContext *ctx )
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_checkedOut.erase(ctx);
+        }
+        sws_freeContext(ctx);
+    }
+
+    void setCapacity( size_t capacity )
+    {
+        std::list<Entry> evicted;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_capacity = capacity;
+            while (m_idle.size() > m_capacity) {
+                evicted.push_back(m_idle.back());
+                m_idle.pop_back();
+                ++m_evictions;
+            }
+        }
+        for (std::list<Entry>::iterator it = evicted.begin(); it != evicted.end(); ++it)
+            sws_freeContext(it->second);
+    }
+
+    size_t capacity() const { return m_capacity; }
+    long hits() const { return m_hits; }
+    long misses() const { return m_misses; }
+    long evictions() const { return m_evictions; }
+
+    void printStats( FILE *f ) const
+    {
+        fprintf(f, "SwsContext cache: %ld hits, %ld misses, %ld evictions\n",
+                hits(), misses(), evictions());
+    }
+};
+
+static inline struct SwsContext *sws_cache_getContext(int srcW, int srcH, enum AVPixelFormat srcFormat,
+                                                      int dstW, int dstH, enum AVPixelFormat dstFormat,
+                                                      int flags, int colorspace = -1, int srcRange = -1)
+{
+    SwsCacheKey key = { srcW, srcH, srcFormat, dstW, dstH, dstFormat, flags, colorspace, srcRange };
+    return SwsContextCache::instance().checkout(key);
+}
+
+static inline void sws_cache_releaseContext(struct SwsContext *ctx)
+{
+    SwsContextCache::instance().checkin(ctx);
+}
+
+static inline void sws_cache_discardContext(struct SwsContext *ctx)
+{
+    SwsContextCache::instance().discard(ctx);
+}
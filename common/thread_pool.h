@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// A fixed-size pool of worker threads fed from one FIFO task queue.
+// wait() blocks until every task submitted so far has finished.
+class ThreadPool{
+private:
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void ()> > m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_taskReady;
+    std::condition_variable m_allDone;
+    int m_pending;
+    bool m_stop;
+private:
+    ThreadPool( const ThreadPool& tp );
+    ThreadPool& operator=( const ThreadPool& tp );
+
+    void workerLoop()
+    {
+        for (;;) {
+            std::function<void ()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_taskReady.wait(lock, [this](){ return m_stop || !m_tasks.empty(); });
+                if (m_tasks.empty())
+                    return;
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            task();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (--m_pending == 0)
+                    m_allDone.notify_all();
+            }
+        }
+    }
+public:
+    // nb_threads <= 0 picks one thread per hardware core
+    explicit ThreadPool( int nb_threads = 0 )
+        : m_pending( 0 ), m_stop( false )
+    {
+        if (nb_threads <= 0)
+            nb_threads = defaultThreadCount();
+        for (int i = 0; i < nb_threads; ++i)
+            m_workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_taskReady.notify_all();
+        for (size_t i = 0; i < m_workers.size(); ++i)
+            m_workers[i].join();
+    }
+
+    static int defaultThreadCount()
+    {
+        int n = (int)std::thread::hardware_concurrency();
+        return n > 0 ? n : 1;
+    }
+
+    int size() const { return (int)m_workers.size(); }
+
+    void submit( std::function<void ()> task )
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::move(task));
+            ++m_pending;
+        }
+        m_taskReady.notify_one();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_allDone.wait(lock, [this](){ return m_pending == 0; });
+    }
+};
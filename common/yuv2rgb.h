@@ -0,0 +1,222 @@
+#pragma once
+/*
+ * YUV420P -> RGB24 同尺寸转换
+ * Dedicated same-size YUV420P/YUVJ420P to RGB24 converter.
+ *
+ * Chroma is nearest-neighbour upsampled (one U/V sample covers a 2x2 block),
+ * which is also what libswscale's unscaled yuv2rgb path does. All variants
+ * (C, SSE2, AVX2) use the same 16 bit fixed point arithmetic:
+ *
+ *   y' = mulhi((Y - yoff) << 6, ycoef) + 4
+ *   R  = (y' + mulhi((V - 128) << 6, vr)) >> 3
+ *   G  = (y' - mulhi((U - 128) << 6, ug) - mulhi((V - 128) << 6, vg)) >> 3
+ *   B  = (y' + mulhi((U - 128) << 6, ub)) >> 3
+ *
+ * with coefficients in Q13 and mulhi(a, b) = (a * b) >> 16, so the SIMD
+ * versions are bit-identical to the C version on every input.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "libavutil/cpu.h"
+#ifdef __cplusplus
+}
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define YUV2RGB_HAVE_X86 1
+#include <immintrin.h>
+#else
+#define YUV2RGB_HAVE_X86 0
+#endif
+
+struct Yuv2RgbMatrix {
+    int16_t yoff, ycoef;    // luma offset and gain (Q13)
+    int16_t vr, ug, vg, ub; // chroma contributions (Q13)
+};
+
+/* bt709: 0 for BT.601, 1 for BT.709; full_range: 0 for 16-235, 1 for 0-255 */
+static inline Yuv2RgbMatrix yuv2rgb_matrix(int bt709, int full_range)
+{
+    double kr = bt709 ? 0.2126 : 0.299;
+    double kb = bt709 ? 0.0722 : 0.114;
+    double kg = 1 - kr - kb;
+    double ys = full_range ? 1.0 : 255.0 / 219.0;
+    double cs = full_range ? 1.0 : 255.0 / 224.0;
+    Yuv2RgbMatrix m;
+
+    m.yoff  = full_range ? 0 : 16;
+    m.ycoef = (int16_t)(ys * 8192 + 0.5);
+    m.vr    = (int16_t)(2 * (1 - kr) * cs * 8192 + 0.5);
+    m.ub    = (int16_t)(2 * (1 - kb) * cs * 8192 + 0.5);
+    m.ug    = (int16_t)(2 * (1 - kb) * kb / kg * cs * 8192 + 0.5);
+    m.vg    = (int16_t)(2 * (1 - kr) * kr / kg * cs * 8192 + 0.5);
+    return m;
+}
+
+typedef void (*Yuv2RgbRowFunc)(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                               uint8_t *dst, int x0, int width, const Yuv2RgbMatrix *m);
+
+static inline uint8_t yuv2rgb_clip(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v;
+}
+
+/* converts pixels [x0, width) of one row */
+static inline void yuv2rgb_row_c(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                                 uint8_t *dst, int x0, int width, const Yuv2RgbMatrix *m)
+{
+    int x;
+    for (x = x0; x < width; x++) {
+        int u6 = (u[x >> 1] - 128) * 64;
+        int v6 = (v[x >> 1] - 128) * 64;
+        int yy = ((y[x] - m->yoff) * 64 * m->ycoef >> 16) + 4;
+        dst[3 * x + 0] = yuv2rgb_clip((yy + (v6 * m->vr >> 16)) >> 3);
+        dst[3 * x + 1] = yuv2rgb_clip((yy - (u6 * m->ug >> 16) - (v6 * m->vg >> 16)) >> 3);
+        dst[3 * x + 2] = yuv2rgb_clip((yy + (u6 * m->ub >> 16)) >> 3);
+    }
+}
+
+#if YUV2RGB_HAVE_X86
+/* 4 RGB0 pixels -> 12 packed RGB bytes in the low 12 bytes */
+__attribute__((target("sse2")))
+static inline __m128i yuv2rgb_pack12_sse2(__m128i x)
+{
+    const __m128i lo24   = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i even   = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+    const __m128i odd    = _mm_set_epi32(0x0000FFFF, (int)0xFF000000, 0x0000FFFF, (int)0xFF000000);
+    const __m128i first6 = _mm_set_epi32(0, 0, 0x0000FFFF, -1);
+    const __m128i next6  = _mm_set_epi32(0, -1, (int)0xFFFF0000, 0);
+    __m128i t = _mm_and_si128(x, lo24);
+    // each 64 bit half: p_even | p_odd << 24
+    __m128i v = _mm_or_si128(_mm_and_si128(t, even), _mm_and_si128(_mm_srli_epi64(t, 8), odd));
+    // glue the two 6 byte halves together
+    return _mm_or_si128(_mm_and_si128(v, first6), _mm_and_si128(_mm_srli_si128(v, 2), next6));
+}
+
+/* interleave 16 R, G and B bytes into 48 bytes at dst, without overrun */
+__attribute__((target("sse2")))
+static inline void yuv2rgb_store48_sse2(uint8_t *dst, __m128i r, __m128i g, __m128i b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i rg_lo = _mm_unpacklo_epi8(r, g), rg_hi = _mm_unpackhi_epi8(r, g);
+    __m128i b0_lo = _mm_unpacklo_epi8(b, zero), b0_hi = _mm_unpackhi_epi8(b, zero);
+    __m128i p3;
+    // the 16 byte stores overlap, each one overwrites the 4 spare bytes of the last
+    _mm_storeu_si128((__m128i *)(dst +  0), yuv2rgb_pack12_sse2(_mm_unpacklo_epi16(rg_lo, b0_lo)));
+    _mm_storeu_si128((__m128i *)(dst + 12), yuv2rgb_pack12_sse2(_mm_unpackhi_epi16(rg_lo, b0_lo)));
+    _mm_storeu_si128((__m128i *)(dst + 24), yuv2rgb_pack12_sse2(_mm_unpacklo_epi16(rg_hi, b0_hi)));
+    p3 = yuv2rgb_pack12_sse2(_mm_unpackhi_epi16(rg_hi, b0_hi));
+    _mm_storel_epi64((__m128i *)(dst + 36), p3);
+    int last = _mm_cvtsi128_si32(_mm_srli_si128(p3, 8));
+    memcpy(dst + 44, &last, 4);
+}
+
+__attribute__((target("sse2")))
+static void yuv2rgb_row_sse2(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                             uint8_t *dst, int x0, int width, const Yuv2RgbMatrix *m)
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i c128  = _mm_set1_epi16(128);
+    const __m128i yoff  = _mm_set1_epi16(m->yoff);
+    const __m128i round = _mm_set1_epi16(4);
+    const __m128i ycoef = _mm_set1_epi16(m->ycoef);
+    const __m128i vr = _mm_set1_epi16(m->vr), ug = _mm_set1_epi16(m->ug);
+    const __m128i vg = _mm_set1_epi16(m->vg), ub = _mm_set1_epi16(m->ub);
+    int x = x0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i u6 = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + (x >> 1))), zero), c128), 6);
+        __m128i v6 = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(v + (x >> 1))), zero), c128), 6);
+        __m128i cr = _mm_mulhi_epi16(v6, vr);
+        __m128i cg = _mm_add_epi16(_mm_mulhi_epi16(u6, ug), _mm_mulhi_epi16(v6, vg));
+        __m128i cb = _mm_mulhi_epi16(u6, ub);
+        __m128i yv = _mm_loadu_si128((const __m128i *)(y + x));
+        __m128i y_lo = _mm_add_epi16(_mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(yv, zero), yoff), 6), ycoef), round);
+        __m128i y_hi = _mm_add_epi16(_mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(yv, zero), yoff), 6), ycoef), round);
+        // one chroma sample per two pixels
+        __m128i r = _mm_packus_epi16(_mm_srai_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(cr, cr)), 3),
+                                     _mm_srai_epi16(_mm_add_epi16(y_hi, _mm_unpackhi_epi16(cr, cr)), 3));
+        __m128i g = _mm_packus_epi16(_mm_srai_epi16(_mm_sub_epi16(y_lo, _mm_unpacklo_epi16(cg, cg)), 3),
+                                     _mm_srai_epi16(_mm_sub_epi16(y_hi, _mm_unpackhi_epi16(cg, cg)), 3));
+        __m128i b = _mm_packus_epi16(_mm_srai_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(cb, cb)), 3),
+                                     _mm_srai_epi16(_mm_add_epi16(y_hi, _mm_unpackhi_epi16(cb, cb)), 3));
+        yuv2rgb_store48_sse2(dst + 3 * x, r, g, b);
+    }
+    yuv2rgb_row_c(y, u, v, dst, x, width, m);
+}
+
+__attribute__((target("avx2")))
+static void yuv2rgb_row_avx2(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                             uint8_t *dst, int x0, int width, const Yuv2RgbMatrix *m)
+{
+    const __m256i c128  = _mm256_set1_epi16(128);
+    const __m256i yoff  = _mm256_set1_epi16(m->yoff);
+    const __m256i round = _mm256_set1_epi16(4);
+    const __m256i ycoef = _mm256_set1_epi16(m->ycoef);
+    const __m256i vr = _mm256_set1_epi16(m->vr), ug = _mm256_set1_epi16(m->ug);
+    const __m256i vg = _mm256_set1_epi16(m->vg), ub = _mm256_set1_epi16(m->ub);
+    int x = x0;
+
+    for (; x + 32 <= width; x += 32) {
+        __m256i u6 = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(u + (x >> 1)))), c128), 6);
+        __m256i v6 = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(v + (x >> 1)))), c128), 6);
+        __m256i c[3], lo[3], hi[3];
+        __m256i y_lo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x)));
+        __m256i y_hi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x + 16)));
+        __m256i out[3];
+        int k;
+
+        c[0] = _mm256_mulhi_epi16(v6, vr);
+        c[1] = _mm256_sub_epi16(_mm256_setzero_si256(),
+                                _mm256_add_epi16(_mm256_mulhi_epi16(u6, ug), _mm256_mulhi_epi16(v6, vg)));
+        c[2] = _mm256_mulhi_epi16(u6, ub);
+        y_lo = _mm256_add_epi16(_mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y_lo, yoff), 6), ycoef), round);
+        y_hi = _mm256_add_epi16(_mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y_hi, yoff), 6), ycoef), round);
+
+        for (k = 0; k < 3; k++) {
+            // duplicate each chroma sample; unpack works per 128 bit lane,
+            // so put the halves back in pixel order afterwards
+            __m256i dl = _mm256_unpacklo_epi16(c[k], c[k]);
+            __m256i dh = _mm256_unpackhi_epi16(c[k], c[k]);
+            lo[k] = _mm256_srai_epi16(_mm256_add_epi16(y_lo, _mm256_permute2x128_si256(dl, dh, 0x20)), 3);
+            hi[k] = _mm256_srai_epi16(_mm256_add_epi16(y_hi, _mm256_permute2x128_si256(dl, dh, 0x31)), 3);
+            out[k] = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo[k], hi[k]), 0xD8);
+        }
+        yuv2rgb_store48_sse2(dst + 3 * x,
+                             _mm256_castsi256_si128(out[0]), _mm256_castsi256_si128(out[1]),
+                             _mm256_castsi256_si128(out[2]));
+        yuv2rgb_store48_sse2(dst + 3 * x + 48,
+                             _mm256_extracti128_si256(out[0], 1), _mm256_extracti128_si256(out[1], 1),
+                             _mm256_extracti128_si256(out[2], 1));
+    }
+    yuv2rgb_row_sse2(y, u, v, dst, x, width, m);
+}
+#endif
+
+/* best row converter for the given av_get_cpu_flags() value */
+static inline Yuv2RgbRowFunc yuv2rgb_get_row_func(int cpu_flags)
+{
+#if YUV2RGB_HAVE_X86
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+        return yuv2rgb_row_avx2;
+    if (cpu_flags & AV_CPU_FLAG_SSE2)
+        return yuv2rgb_row_sse2;
+#endif
+    return yuv2rgb_row_c;
+}
+
+/* converts rows [y0, y1) of a YUV420P picture into packed RGB24 */
+static inline void yuv420p_to_rgb24(Yuv2RgbRowFunc row, const uint8_t *const src[], const int srcStride[],
+                                    uint8_t *dst, int dstStride, int width, int y0, int y1,
+                                    const Yuv2RgbMatrix *m)
+{
+    int y;
+    for (y = y0; y < y1; y++)
+        row(src[0] + y * srcStride[0], src[1] + (y >> 1) * srcStride[1], src[2] + (y >> 1) * srcStride[2],
+            dst + y * dstStride, 0, width, m);
+}
@@ -34,6 +34,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <thread>
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -42,22 +49,67 @@ extern "C" {
 #include "libavutil/opt.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/timestamp.h"
+#include "libavutil/time.h"
+#include "libavutil/parseutils.h"
 #include "libavformat/avformat.h"
 #include "libswscale/swscale.h"
 #include "libswresample/swresample.h"
 #ifdef __cplusplus
 }
 #endif
+#include "../../common/slice_sws.h"
+#include "../../common/packet_interleaver.h"
+#include "../../common/blocking_queue.h"
+#include "../../common/thread_pool.h"
+#include "../../common/lock_manager.h"
+#include "../../common/avio_sink.h"
+#include "../../common/audio_convert.h"
 #define STREAM_DURATION   10.0  //视频时长，以秒计数
 #define STREAM_FRAME_RATE 25 /* 25 images/s */
 #define STREAM_PIX_FMT    AV_PIX_FMT_YUV420P /* default pix_fmt */
 
 #define SCALE_FLAGS SWS_BICUBIC
 
+// memory the interleaver may hold before it writes packets out of order
+#define MUX_MEMORY_BUDGET (16 << 20)
+// queued packets spanning more than this are written without waiting for every stream
+#define MUX_MAX_DELTA_MS  1000
+#define MAX_AUDIO_TRACKS  16
+
+// what add_stream() sets up for a video + audio pair
+typedef struct StreamProfile {
+    const char *video_encoder;  // encoder name, NULL for the format's default codec
+    int width, height;          // must be a multiple of two
+    int frame_rate;
+    int video_bit_rate, audio_bit_rate;
+    double duration;            // seconds
+    int threads;                // codec threads, 0 for the libavcodec default
+} StreamProfile;
+
+static StreamProfile default_profile = {
+    NULL, 352, 288, STREAM_FRAME_RATE, 400000, 64000, STREAM_DURATION, 0
+};
+
+// print every packet as it is muxed
+static int log_packets = 1;
+
+// produce interleaved S16 audio like a capture device, instead of the encoder's format
+static int audio_source_s16 = 0;
+
+/* Real-time mode: frames are generated no earlier than their timestamp on
+ * the wall clock, and a video frame that is already more than
+ * realtime_drop frame periods late is skipped. Negative means never drop. */
+static int realtime = 0;
+static double realtime_drop = 1.0;
+static int64_t realtime_start;
+
 // a wrapper around a single output AVStream
 typedef struct OutputStream {
     AVStream *st;
     
+    /* length of the stream in seconds */
+    double duration;
+    
     /* pts of the next frame that will be generated */
     int64_t next_pts;
     int samples_count;
@@ -67,14 +119,31 @@ typedef struct OutputStream {
     
     float t, tincr, tincr2;
     
-    struct SwsContext *sws_ctx;
+    SliceSwsContext *sws_ctx;
     struct SwrContext *swr_ctx;
+    
+    /* sample format get_audio_frame() produces; when it differs from the
+     * encoder's, tmp_frame holds the source and is converted into frame */
+    enum AVSampleFormat src_fmt;
+    S16ToFltpFunc s16_to_fltp;
+    
+    /* when set, packets go to this interleaver in stream time base instead
+     * of straight to the muxer; see mux_queued_packets() */
+    PacketInterleaver *interleaver;
+    int interleave_index;
+    
+    /* real-time statistics: load is the time spent generating and
+     * encoding a frame as a fraction of the frame's duration */
+    int rt_frames, rt_dropped, rt_over_budget;
+    double rt_load_sum, rt_load_max;
 } OutputStream;
 
 static void log_packet(const AVFormatContext *fmt_ctx, const AVPacket *pkt)
 {
     AVRational *time_base = &fmt_ctx->streams[pkt->stream_index]->time_base;
     
+    if (!log_packets)
+        return;
     printf("pts:%s pts_time:%s dts:%s dts_time:%s duration:%s duration_time:%s stream_index:%d\n",
            av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, time_base),
            av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, time_base),
@@ -82,6 +151,184 @@ static void log_packet(const AVFormatContext *fmt_ctx, const AVPacket *pkt)
            pkt->stream_index);
 }
 
+/**************************************************************/
+/* tee output */
+
+// packets a tee output may lag behind the main output
+#define TEE_QUEUE_SIZE 512
+
+/* An extra output fed with the packets of the main one. The packets are
+ * encoded once; every tee output gets a new reference to the same
+ * payload and writes it on its own thread. Normally a full queue makes
+ * the mux thread wait, so a slow output slows the run down but gets every
+ * packet. In -realtime mode the mux thread never waits: the packet is
+ * dropped for that output, and the rest of the stream is dropped up to
+ * its next keyframe so the output stays decodable. An output that failed
+ * is not fed at all. Drops and write errors make the run fail. */
+struct TeeOutput {
+    std::string filename;
+    AVFormatContext *oc;
+    BlockingQueue<AVPacket *> *queue;
+    std::thread writer;
+    long packets, dropped;
+    std::vector<bool> wait_key;     // per stream, dropping until a keyframe
+    std::atomic<int> error;
+};
+
+static std::vector<TeeOutput *> tee_outputs;
+// the context whose packets are copied to the tee outputs
+static AVFormatContext *tee_source;
+
+// allocated before the encoders are opened so their header flags are known
+static void tee_alloc(const char *filename)
+{
+    TeeOutput *t = new TeeOutput();
+    
+    t->filename = filename;
+    t->packets = t->dropped = 0;
+    t->error = 0;
+    avformat_alloc_output_context2(&t->oc, NULL, NULL, filename);
+    if (!t->oc) {
+        fprintf(stderr, "Could not deduce output format of '%s'\n", filename);
+        exit(1);
+    }
+    tee_outputs.push_back(t);
+}
+
+static int tee_needs_global_header(void)
+{
+    for (size_t i = 0; i < tee_outputs.size(); i++)
+        if (tee_outputs[i]->oc->oformat->flags & AVFMT_GLOBALHEADER)
+            return 1;
+    return 0;
+}
+
+static void tee_write_loop(TeeOutput *t)
+{
+    AVPacket *pkt;
+    
+    while (t->queue->pop(pkt)) {
+        if (!t->error) {
+            AVStream *src = tee_source->streams[pkt->stream_index];
+            AVStream *dst = t->oc->streams[pkt->stream_index];
+            int ret;
+            
+            // each container picks its own time base in avformat_write_header
+            av_packet_rescale_ts(pkt, src->time_base, dst->time_base);
+            ret = av_interleaved_write_frame(t->oc, pkt);
+            if (ret < 0) {
+                fprintf(stderr, "Error while writing to '%s': %s\n", t->filename.c_str(), av_err2str(ret));
+                t->error = 1;
+            }
+            t->packets++;
+        }
+        av_packet_unref(pkt);
+        av_free(pkt);
+    }
+}
+
+/* Mirror the main output's streams, write the headers and start the
+ * writers. Called once the encoders are open and the main header is
+ * written, so extradata and the main time bases are final. */
+static void tee_open(AVFormatContext *oc)
+{
+    size_t i;
+    unsigned j;
+    int ret;
+    
+    tee_source = oc;
+    for (i = 0; i < tee_outputs.size(); i++) {
+        TeeOutput *t = tee_outputs[i];
+        
+        for (j = 0; j < oc->nb_streams; j++) {
+            AVStream *st = avformat_new_stream(t->oc, NULL);
+            if (!st || avcodec_copy_context(st->codec, oc->streams[j]->codec) < 0) {
+                fprintf(stderr, "Could not copy stream %u to '%s'\n", j, t->filename.c_str());
+                exit(1);
+            }
+            st->time_base = oc->streams[j]->time_base;
+            st->codec->codec_tag = 0;
+            if (t->oc->oformat->flags & AVFMT_GLOBALHEADER)
+                st->codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        if (!(t->oc->oformat->flags & AVFMT_NOFILE)) {
+            ret = avio_open(&t->oc->pb, t->filename.c_str(), AVIO_FLAG_WRITE);
+            if (ret < 0) {
+                fprintf(stderr, "Could not open '%s': %s\n", t->filename.c_str(), av_err2str(ret));
+                exit(1);
+            }
+        }
+        ret = avformat_write_header(t->oc, NULL);
+        if (ret < 0) {
+            fprintf(stderr, "Error occurred when opening '%s': %s\n", t->filename.c_str(), av_err2str(ret));
+            exit(1);
+        }
+        t->wait_key.assign(oc->nb_streams, false);
+        t->queue  = new BlockingQueue<AVPacket *>(TEE_QUEUE_SIZE);
+        t->writer = std::thread(tee_write_loop, t);
+    }
+}
+
+// hand a packet of the main output, in its stream time base, to every tee output
+static void tee_packet(AVFormatContext *fmt_ctx, const AVPacket *pkt)
+{
+    if (fmt_ctx != tee_source)
+        return;
+    for (size_t i = 0; i < tee_outputs.size(); i++) {
+        TeeOutput *t = tee_outputs[i];
+        AVPacket *ref;
+        
+        if (t->error)
+            continue;
+        if (t->wait_key[pkt->stream_index]) {
+            if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+                t->dropped++;
+                continue;
+            }
+            t->wait_key[pkt->stream_index] = false;
+        }
+        ref = (AVPacket *)av_malloc(sizeof(*ref));
+        if (ref && av_packet_ref(ref, pkt) < 0)
+            av_freep(&ref);
+        if (!ref || !(realtime ? t->queue->tryPush(ref) : t->queue->push(ref))) {
+            // the output is behind; skip to the next keyframe of this stream
+            if (ref) {
+                av_packet_unref(ref);
+                av_free(ref);
+            }
+            t->wait_key[pkt->stream_index] = true;
+            t->dropped++;
+        }
+    }
+}
+
+// returns <0 if any tee output failed or lost packets
+static int tee_close(void)
+{
+    int ret = 0;
+    
+    for (size_t i = 0; i < tee_outputs.size(); i++) {
+        TeeOutput *t = tee_outputs[i];
+        
+        t->queue->close();
+        t->writer.join();
+        if (!t->error && av_write_trailer(t->oc) < 0)
+            t->error = 1;
+        fprintf(stderr, "%s: %ld packets, %ld dropped%s\n", t->filename.c_str(), t->packets, t->dropped,
+                t->error ? ", failed" : "");
+        if (t->error || t->dropped)
+            ret = -1;
+        if (!(t->oc->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&t->oc->pb);
+        avformat_free_context(t->oc);
+        delete t->queue;
+        delete t;
+    }
+    tee_outputs.clear();
+    tee_source = NULL;
+    return ret;
+}
+
 static int write_frame(AVFormatContext *fmt_ctx, const AVRational *time_base, AVStream *st, AVPacket *pkt)
 {
     /* rescale output packet timestamp values from codec to stream timebase */
@@ -90,38 +337,80 @@ static int write_frame(AVFormatContext *fmt_ctx, const AVRational *time_base, AV
     
     /* Write the compressed frame to the media file. */
     log_packet(fmt_ctx, pkt);
+    tee_packet(fmt_ctx, pkt);
     //交叉填入音频 视频 数据，根据pkt->stream_index来区别
     return av_interleaved_write_frame(fmt_ctx, pkt);
 }
 
+// the dts the muxer orders packets by, pts for streams without dts
+static int64_t packet_time(const AVPacket *pkt)
+{
+    return pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+}
+
+/* Hand an encoded packet to the muxer: written directly in the serial
+ * loop, queued for the muxer when the stream is encoded on its own thread. */
+static int send_packet(AVFormatContext *fmt_ctx, OutputStream *ost, AVPacket *pkt)
+{
+    AVPacket *queued;
+    
+    if (!ost->interleaver)
+        return write_frame(fmt_ctx, &ost->st->codec->time_base, ost->st, pkt);
+    
+    av_packet_rescale_ts(pkt, ost->st->codec->time_base, ost->st->time_base);
+    pkt->stream_index = ost->st->index;
+    
+    // the encoder reuses its buffers unless the packet owns its data
+    if (av_dup_packet(pkt) < 0 || !(queued = (AVPacket *)av_malloc(sizeof(*queued)))) {
+        av_free_packet(pkt);
+        return AVERROR(ENOMEM);
+    }
+    *queued = *pkt;
+    ost->interleaver->push(ost->interleave_index, queued);
+    return 0;
+}
+
 /* Add an output stream. */
-static void add_stream(OutputStream *ost, AVFormatContext *oc,
+static int add_stream(OutputStream *ost, AVFormatContext *oc,
                        AVCodec **codec,
-                       enum AVCodecID codec_id)
+                       enum AVCodecID codec_id,
+                       const StreamProfile *profile)
 {
     AVCodecContext *c;
     int i;
     
     /* find the encoder */
     //找到编解码器
-    *codec = avcodec_find_encoder(codec_id);
+    if (profile->video_encoder && avcodec_get_type(codec_id) == AVMEDIA_TYPE_VIDEO) {
+        *codec = avcodec_find_encoder_by_name(profile->video_encoder);
+        if (!(*codec) || (*codec)->type != AVMEDIA_TYPE_VIDEO) {
+            fprintf(stderr, "Could not find video encoder '%s'\n", profile->video_encoder);
+            return AVERROR_ENCODER_NOT_FOUND;
+        }
+        codec_id = (*codec)->id;
+    } else {
+        *codec = avcodec_find_encoder(codec_id);
+    }
     if (!(*codec)) {
         fprintf(stderr, "Could not find encoder for '%s'\n",
                 avcodec_get_name(codec_id));
-        exit(1);
+        return AVERROR_ENCODER_NOT_FOUND;
     }
+    ost->duration = profile->duration;
     
     //创建一条新的流,这个流依附在oc上
     ost->st = avformat_new_stream(oc, *codec);
     if (!ost->st) {
         fprintf(stderr, "Could not allocate stream\n");
-        exit(1);
+        return AVERROR(ENOMEM);
     }
     //why??
     //设置id
     ost->st->id = oc->nb_streams-1;
     //用于设置编解码的参数
     c = ost->st->codec;
+    if (profile->threads > 0)
+        c->thread_count = profile->threads;
     
     switch ((*codec)->type) {
             //音频流
@@ -129,7 +418,7 @@ static void add_stream(OutputStream *ost, AVFormatContext *oc,
             //设置音频的格式
             c->sample_fmt  = (*codec)->sample_fmts ?
             (*codec)->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
-            c->bit_rate    = 64000; //码流
+            c->bit_rate    = profile->audio_bit_rate; //码流
             c->sample_rate = 44100;
             //设置采样率
             if ((*codec)->supported_samplerates) {
@@ -160,15 +449,15 @@ static void add_stream(OutputStream *ost, AVFormatContext *oc,
             //编解码器的id
             c->codec_id = codec_id;
             
-            c->bit_rate = 400000;
+            c->bit_rate = profile->video_bit_rate;
             /* Resolution must be a multiple of two. */
-            c->width    = 352;
-            c->height   = 288;
+            c->width    = profile->width;
+            c->height   = profile->height;
             /* timebase: This is the fundamental unit of time (in seconds) in terms
              * of which frame timestamps are represented. For fixed-fps content,
              * timebase should be 1/framerate and timestamp increments should be
              * identical to 1. */
-            ost->st->time_base = (AVRational){ 1, STREAM_FRAME_RATE };
+            ost->st->time_base = (AVRational){ 1, profile->frame_rate };
             c->time_base       = ost->st->time_base;
             
             //the number of pictures in a group of pictures, or 0 for intra_only
@@ -191,8 +480,9 @@ static void add_stream(OutputStream *ost, AVFormatContext *oc,
     }
     
     /* Some formats want stream headers to be separate. */
-    if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+    if ((oc->oformat->flags & AVFMT_GLOBALHEADER) || (oc == tee_source && tee_needs_global_header()))
         c->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    return 0;
 }
 
 /**************************************************************/
@@ -207,7 +497,7 @@ static AVFrame *alloc_audio_frame(enum AVSampleFormat sample_fmt,
     
     if (!frame) {
         fprintf(stderr, "Error allocating an audio frame\n");
-        exit(1);
+        return NULL;
     }
     
     frame->format = sample_fmt;
@@ -219,14 +509,29 @@ static AVFrame *alloc_audio_frame(enum AVSampleFormat sample_fmt,
         ret = av_frame_get_buffer(frame, 0);
         if (ret < 0) {
             fprintf(stderr, "Error allocating an audio buffer\n");
-            exit(1);
+            av_frame_free(&frame);
+            return NULL;
         }
     }
     
     return frame;
 }
 
-static void open_audio(AVFormatContext *oc, AVCodec *codec, OutputStream *ost, AVDictionary *opt_arg)
+// the format the signal generator should produce for an encoder format
+static enum AVSampleFormat negotiate_sample_fmt(enum AVSampleFormat codec_fmt)
+{
+    switch (codec_fmt) {
+        case AV_SAMPLE_FMT_S16:
+        case AV_SAMPLE_FMT_S16P:
+        case AV_SAMPLE_FMT_FLT:
+        case AV_SAMPLE_FMT_FLTP:
+            return codec_fmt;
+        default:
+            return AV_SAMPLE_FMT_S16;
+    }
+}
+
+static int open_audio(AVFormatContext *oc, AVCodec *codec, OutputStream *ost, AVDictionary *opt_arg)
 {
     AVCodecContext *c;
     int nb_samples;
@@ -242,7 +547,7 @@ static void open_audio(AVFormatContext *oc, AVCodec *codec, OutputStream *ost, A
     av_dict_free(&opt);
     if (ret < 0) {
         fprintf(stderr, "Could not open audio codec: %s\n", av_err2str(ret));
-        exit(1);
+        return ret;
     }
     
     /* init signal generator */
@@ -259,21 +564,36 @@ static void open_audio(AVFormatContext *oc, AVCodec *codec, OutputStream *ost, A
     
     ost->frame     = alloc_audio_frame(c->sample_fmt, c->channel_layout,
                                        c->sample_rate, nb_samples);
-    ost->tmp_frame = alloc_audio_frame(AV_SAMPLE_FMT_S16, c->channel_layout,
+    if (!ost->frame)
+        return AVERROR(ENOMEM);
+    
+    /* The signal generator writes S16, S16P, FLT and FLTP directly, so for
+     * almost every encoder no conversion is needed at all. */
+    ost->src_fmt = audio_source_s16 ? AV_SAMPLE_FMT_S16 : negotiate_sample_fmt(c->sample_fmt);
+    if (ost->src_fmt == c->sample_fmt)
+        return 0;
+    
+    ost->tmp_frame = alloc_audio_frame(ost->src_fmt, c->channel_layout,
                                        c->sample_rate, nb_samples);
+    if (!ost->tmp_frame)
+        return AVERROR(ENOMEM);
+    if (ost->src_fmt == AV_SAMPLE_FMT_S16 && c->sample_fmt == AV_SAMPLE_FMT_FLTP) {
+        ost->s16_to_fltp = s16_to_fltp_get_func(av_get_cpu_flags());
+        return 0;
+    }
     
     /* create resampler context */
     //获取重采样上下文
     ost->swr_ctx = swr_alloc();
     if (!ost->swr_ctx) {
         fprintf(stderr, "Could not allocate resampler context\n");
-        exit(1);
+        return AVERROR(ENOMEM);
     }
     
     /* set options */
     av_opt_set_int       (ost->swr_ctx, "in_channel_count",   c->channels,       0);
     av_opt_set_int       (ost->swr_ctx, "in_sample_rate",     c->sample_rate,    0);
-    av_opt_set_sample_fmt(ost->swr_ctx, "in_sample_fmt",      AV_SAMPLE_FMT_S16, 0);
+    av_opt_set_sample_fmt(ost->swr_ctx, "in_sample_fmt",      ost->src_fmt,      0);
     av_opt_set_int       (ost->swr_ctx, "out_channel_count",  c->channels,       0);
     av_opt_set_int       (ost->swr_ctx, "out_sample_rate",    c->sample_rate,    0);
     av_opt_set_sample_fmt(ost->swr_ctx, "out_sample_fmt",     c->sample_fmt,     0);
@@ -282,27 +602,43 @@ static void open_audio(AVFormatContext *oc, AVCodec *codec, OutputStream *ost, A
     //初始化重采样上下文
     if ((ret = swr_init(ost->swr_ctx)) < 0) {
         fprintf(stderr, "Failed to initialize the resampling context\n");
-        exit(1);
+        return ret;
     }
+    return 0;
 }
 
-/* Prepare a 16 bit dummy audio frame of 'frame_size' samples and
- * 'nb_channels' channels. */
+/* Prepare a dummy audio frame of 'frame_size' samples and 'nb_channels'
+ * channels in ost->src_fmt. The signal is the same 16 bit tone in every
+ * format, float formats get exactly what swr would make of it. */
 static AVFrame *get_audio_frame(OutputStream *ost)
 {
-    AVFrame *frame = ost->tmp_frame;
+    AVFrame *frame = ost->tmp_frame ? ost->tmp_frame : ost->frame;
+    int channels = ost->st->codec->channels;
     int j, i, v;
-    int16_t *q = (int16_t*)frame->data[0];
     
     /* check if we want to generate more frames */
     if (av_compare_ts(ost->next_pts, ost->st->codec->time_base,
-                      STREAM_DURATION, (AVRational){ 1, 1 }) >= 0)
+                      (int64_t)(ost->duration * 1000), (AVRational){ 1, 1000 }) >= 0)
         return NULL;
     
     for (j = 0; j <frame->nb_samples; j++) {
         v = (int)(sin(ost->t) * 10000);
-        for (i = 0; i < ost->st->codec->channels; i++)
-            *q++ = v;
+        for (i = 0; i < channels; i++) {
+            switch (ost->src_fmt) {
+                case AV_SAMPLE_FMT_S16P:
+                    ((int16_t *)frame->extended_data[i])[j] = v;
+                    break;
+                case AV_SAMPLE_FMT_FLT:
+                    ((float *)frame->data[0])[j * channels + i] = v * (1.0f / (1 << 15));
+                    break;
+                case AV_SAMPLE_FMT_FLTP:
+                    ((float *)frame->extended_data[i])[j] = v * (1.0f / (1 << 15));
+                    break;
+                default:
+                    ((int16_t *)frame->data[0])[j * channels + i] = v;
+                    break;
+            }
+        }
         ost->t     += ost->tincr;
         ost->tincr += ost->tincr2;
     }
@@ -315,7 +651,8 @@ static AVFrame *get_audio_frame(OutputStream *ost)
 
 /*
  * encode one audio frame and send it to the muxer
- * return 1 when encoding is finished, 0 otherwise
+ * return 1 when encoding is finished, 0 otherwise, a negative error code
+ * if encoding or writing failed
  */
 static int write_audio_frame(AVFormatContext *oc, OutputStream *ost)
 {
@@ -329,31 +666,40 @@ static int write_audio_frame(AVFormatContext *oc, OutputStream *ost)
     av_init_packet(&pkt);
     c = ost->st->codec;
     
+    /* when we pass a frame to the encoder, it may keep a reference to it
+     * internally;
+     * make sure we do not overwrite it here
+     */
+    ret = av_frame_make_writable(ost->frame);
+    if (ret < 0)
+        return ret;
+    
     frame = get_audio_frame(ost);
     
-    if (frame) {
-        /* convert samples from native format to destination codec format, using the resampler */
-        /* compute destination number of samples */
-        dst_nb_samples = av_rescale_rnd(swr_get_delay(ost->swr_ctx, c->sample_rate) + frame->nb_samples,c->sample_rate, c->sample_rate, AV_ROUND_UP);
-        av_assert0(dst_nb_samples == frame->nb_samples);
-        
-        /* when we pass a frame to the encoder, it may keep a reference to it
-         * internally;
-         * make sure we do not overwrite it here
-         */
-        ret = av_frame_make_writable(ost->frame);
-        if (ret < 0)
-            exit(1);
-        
-        /* convert to destination format */
-        ret = swr_convert(ost->swr_ctx,
-                          ost->frame->data, dst_nb_samples,
-                          (const uint8_t **)frame->data, frame->nb_samples);
-        if (ret < 0) {
-            fprintf(stderr, "Error while converting\n");
-            exit(1);
+    if (frame && frame != ost->frame) {
+        if (ost->s16_to_fltp) {
+            ost->s16_to_fltp((float *const *)ost->frame->extended_data, (const int16_t *)frame->data[0],
+                             c->channels, frame->nb_samples);
+        } else {
+            /* convert samples from native format to destination codec format, using the resampler */
+            /* compute destination number of samples */
+            dst_nb_samples = av_rescale_rnd(swr_get_delay(ost->swr_ctx, c->sample_rate) + frame->nb_samples,c->sample_rate, c->sample_rate, AV_ROUND_UP);
+            av_assert0(dst_nb_samples == frame->nb_samples);
+            
+            /* convert to destination format */
+            ret = swr_convert(ost->swr_ctx,
+                              ost->frame->data, dst_nb_samples,
+                              (const uint8_t **)frame->data, frame->nb_samples);
+            if (ret < 0) {
+                fprintf(stderr, "Error while converting\n");
+                return ret;
+            }
         }
         frame = ost->frame;
+    }
+    
+    if (frame) {
+        dst_nb_samples = frame->nb_samples;
         
         frame->pts = av_rescale_q(ost->samples_count, (AVRational){1, c->sample_rate}, c->time_base);
         ost->samples_count += dst_nb_samples;
@@ -362,15 +708,15 @@ static int write_audio_frame(AVFormatContext *oc, OutputStream *ost)
     ret = avcodec_encode_audio2(c, &pkt, frame, &got_packet);
     if (ret < 0) {
         fprintf(stderr, "Error encoding audio frame: %s\n", av_err2str(ret));
-        exit(1);
+        return ret;
     }
     
     if (got_packet) {
-        ret = write_frame(oc, &c->time_base, ost->st, &pkt);
+        ret = send_packet(oc, ost, &pkt);
         if (ret < 0) {
             fprintf(stderr, "Error while writing audio frame: %s\n",
                     av_err2str(ret));
-            exit(1);
+            return ret;
         }
     }
     
@@ -397,13 +743,14 @@ static AVFrame *alloc_picture(enum AVPixelFormat pix_fmt, int width, int height)
     ret = av_frame_get_buffer(picture, 32);
     if (ret < 0) {
         fprintf(stderr, "Could not allocate frame data.\n");
-        exit(1);
+        av_frame_free(&picture);
+        return NULL;
     }
     
     return picture;
 }
 //打开编码器，申请各种内存，
-static void open_video(AVFormatContext *oc, AVCodec *codec, OutputStream *ost, AVDictionary *opt_arg)
+static int open_video(AVFormatContext *oc, AVCodec *codec, OutputStream *ost, AVDictionary *opt_arg)
 {
     int ret;
     //用于设置编解码器
@@ -419,14 +766,14 @@ static void open_video(AVFormatContext *oc, AVCodec *codec, OutputStream *ost, A
     av_dict_free(&opt);
     if (ret < 0) {
         fprintf(stderr, "Could not open video codec: %s\n", av_err2str(ret));
-        exit(1);
+        return ret;
     }
     
     /* allocate and init a re-usable frame */
     ost->frame = alloc_picture(c->pix_fmt, c->width, c->height);
     if (!ost->frame) {
         fprintf(stderr, "Could not allocate video frame\n");
-        exit(1);
+        return AVERROR(ENOMEM);
     }
     
     /* If the output format is not YUV420P, then a temporary YUV420P
@@ -437,24 +784,29 @@ static void open_video(AVFormatContext *oc, AVCodec *codec, OutputStream *ost, A
         ost->tmp_frame = alloc_picture(AV_PIX_FMT_YUV420P, c->width, c->height);
         if (!ost->tmp_frame) {
             fprintf(stderr, "Could not allocate temporary picture\n");
-            exit(1);
+            return AVERROR(ENOMEM);
+        }
+        /* as we only generate a YUV420P picture, we must convert it
+         * to the codec pixel format */
+        ost->sws_ctx = slice_sws_getContext(c->width, c->height,
+                                            AV_PIX_FMT_YUV420P,
+                                            c->width, c->height,
+                                            c->pix_fmt,
+                                            SCALE_FLAGS, 0);
+        if (!ost->sws_ctx) {
+            fprintf(stderr,
+                    "Could not initialize the conversion context\n");
+            return AVERROR(EINVAL);
         }
     }
+    return 0;
 }
 
 /* Prepare a dummy image. */
 static void fill_yuv_image(AVFrame *pict, int frame_index,
                            int width, int height)
 {
-    int x, y, i, ret;
-    
-    /* when we pass a frame to the encoder, it may keep a reference to it
-     * internally;
-     * make sure we do not overwrite it here
-     */
-    ret = av_frame_make_writable(pict);
-    if (ret < 0)
-        exit(1);
+    int x, y, i;
     
     i = frame_index;
     
@@ -479,32 +831,18 @@ static AVFrame *get_video_frame(OutputStream *ost)
     /* check if we want to generate more frames */
     //如果时间 大于 我们希望的时长
     if (av_compare_ts(ost->next_pts, ost->st->codec->time_base,
-                      STREAM_DURATION, (AVRational){ 1, 1 }) >= 0)
+                      (int64_t)(ost->duration * 1000), (AVRational){ 1, 1000 }) >= 0)
         return NULL;
     
     //如果不是默认的 YUV420P格式
     if (c->pix_fmt != AV_PIX_FMT_YUV420P) {
-        /* as we only generate a YUV420P picture, we must convert it
-         * to the codec pixel format if needed */
-        //获得转换格式的上下文
-        if (!ost->sws_ctx) {
-            ost->sws_ctx = sws_getContext(c->width, c->height,
-                                          AV_PIX_FMT_YUV420P,
-                                          c->width, c->height,
-                                          c->pix_fmt,
-                                          SCALE_FLAGS, NULL, NULL, NULL);
-            if (!ost->sws_ctx) {
-                fprintf(stderr,
-                        "Could not initialize the conversion context\n");
-                exit(1);
-            }
-        }
+        /* the conversion context was created by open_video() */
         //获得一个随意制造的video frame
         fill_yuv_image(ost->tmp_frame, ost->next_pts, c->width, c->height);
         //转换成目标格式
-        sws_scale(ost->sws_ctx,
-                  (const uint8_t * const *)ost->tmp_frame->data, ost->tmp_frame->linesize,
-                  0, c->height, ost->frame->data, ost->frame->linesize);
+        slice_sws_scale(ost->sws_ctx,
+                        (const uint8_t * const *)ost->tmp_frame->data, ost->tmp_frame->linesize,
+                        ost->frame->data, ost->frame->linesize);
     } else {
         fill_yuv_image(ost->frame, ost->next_pts, c->width, c->height);
     }
@@ -516,7 +854,8 @@ static AVFrame *get_video_frame(OutputStream *ost)
 
 /*
  * encode one video frame and send it to the muxer
- * return 1 when encoding is finished, 0 otherwise
+ * return 1 when encoding is finished, 0 otherwise, a negative error code
+ * if encoding or writing failed
  */
 static int write_video_frame(AVFormatContext *oc, OutputStream *ost)
 {
@@ -526,6 +865,13 @@ static int write_video_frame(AVFormatContext *oc, OutputStream *ost)
     int got_packet = 0;
     
     c = ost->st->codec;
+    /* when we pass a frame to the encoder, it may keep a reference to it
+     * internally;
+     * make sure we do not overwrite it here
+     */
+    ret = av_frame_make_writable(ost->frame);
+    if (ret < 0)
+        return ret;
     //获取一帧画面
     frame = get_video_frame(ost);
     
@@ -555,11 +901,11 @@ static int write_video_frame(AVFormatContext *oc, OutputStream *ost)
         ret = avcodec_encode_video2(c, &pkt, frame, &got_packet);
         if (ret < 0) {
             fprintf(stderr, "Error encoding video frame: %s\n", av_err2str(ret));
-            exit(1);
+            return ret;
         }
         
         if (got_packet) {
-            ret = write_frame(oc, &c->time_base, ost->st, &pkt);
+            ret = send_packet(oc, ost, &pkt);
         } else {
             ret = 0;
         }
@@ -567,7 +913,7 @@ static int write_video_frame(AVFormatContext *oc, OutputStream *ost)
     
     if (ret < 0) {
         fprintf(stderr, "Error while writing video frame: %s\n", av_err2str(ret));
-        exit(1);
+        return ret;
     }
     
     return (frame || got_packet) ? 0 : 1;
@@ -578,16 +924,635 @@ static void close_stream(AVFormatContext *oc, OutputStream *ost)
     avcodec_close(ost->st->codec);
     av_frame_free(&ost->frame);
     av_frame_free(&ost->tmp_frame);
-    sws_freeContext(ost->sws_ctx);
+    slice_sws_freeContext(ost->sws_ctx);
     swr_free(&ost->swr_ctx);
 }
 
+/**************************************************************/
+/* chunked CMAF output */
+
+// default length of one CMAF chunk (moof+mdat), in milliseconds
+#define CMAF_CHUNK_MS 200
+
+/* Fragmented MP4 cut into segments of about segment_duration seconds,
+ * each made of chunks of about chunk_duration. The mp4 muxer writes into
+ * a non-seekable memory sink and is flushed with av_write_frame(oc, NULL)
+ * at every chunk boundary, so each chunk's bytes are known the moment it
+ * is cut. A segment collects its chunks in memory and is only published,
+ * under its final name, when it is complete. */
+struct CmafOutput {
+    AvioSink *sink;
+    std::string prefix;             // output name without extension
+    int64_t segment_duration;       // AV_TIME_BASE units
+    int64_t chunk_duration;
+    
+    int segment_index;
+    int64_t segment_start;          // media time of the current segment, -1 before the first
+    int64_t chunk_start;
+    std::vector<uint8_t> segment;   // finished chunks of the current segment
+    
+    int64_t start_time;             // wall clock when the header was written
+    int64_t chunk_wall_start;       // wall clock of the first packet of the current chunk
+    bool chunk_open;                // packets were written since the last cut
+    int64_t first_byte_time;        // wall clock when the first media chunk was ready
+    int nb_chunks;
+    int64_t chunk_latency_sum, chunk_latency_max;
+};
+
+// write to a temporary name and rename, readers never see a partial file
+static int publish_file(const std::string& path, const uint8_t *data, size_t size)
+{
+    std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    
+    if (!f)
+        return AVERROR(EIO);
+    if (fwrite(data, 1, size, f) != size) {
+        fclose(f);
+        unlink(tmp.c_str());
+        return AVERROR(EIO);
+    }
+    if (fclose(f) || rename(tmp.c_str(), path.c_str())) {
+        unlink(tmp.c_str());
+        return AVERROR(EIO);
+    }
+    return 0;
+}
+
+static void cmaf_publish_segment(CmafOutput *cmaf)
+{
+    char name[32];
+    
+    if (cmaf->segment.empty())
+        return;
+    snprintf(name, sizeof(name), "_%05d.m4s", cmaf->segment_index++);
+    if (publish_file(cmaf->prefix + name, cmaf->segment.data(), cmaf->segment.size()) < 0) {
+        fprintf(stderr, "Could not publish segment %s%s\n", cmaf->prefix.c_str(), name);
+        exit(1);
+    }
+    cmaf->segment.clear();
+}
+
+// cut the fragment the muxer has buffered and append it to the segment
+static void cmaf_flush_chunk(AVFormatContext *oc, CmafOutput *cmaf)
+{
+    std::vector<uint8_t> chunk;
+    int64_t now, latency;
+    int ret;
+    
+    ret = av_write_frame(oc, NULL);
+    if (ret < 0) {
+        fprintf(stderr, "Error while flushing fragment: %s\n", av_err2str(ret));
+        exit(1);
+    }
+    avio_flush(oc->pb);
+    cmaf->sink->takeBuffer(chunk);
+    if (!cmaf->chunk_open || chunk.empty())
+        return;
+    cmaf->chunk_open = false;
+    
+    now = av_gettime_relative();
+    if (!cmaf->nb_chunks)
+        cmaf->first_byte_time = now;
+    latency = now - cmaf->chunk_wall_start;
+    cmaf->chunk_latency_sum += latency;
+    cmaf->chunk_latency_max = FFMAX(cmaf->chunk_latency_max, latency);
+    cmaf->nb_chunks++;
+    
+    cmaf->segment.insert(cmaf->segment.end(), chunk.begin(), chunk.end());
+}
+
+/* Called by the muxer for every packet, before it is written. Chunks and
+ * segments start on video packets, segments only on keyframes so that
+ * every segment can be decoded on its own. */
+static void cmaf_before_packet(AVFormatContext *oc, CmafOutput *cmaf, const AVPacket *pkt)
+{
+    AVStream *st = oc->streams[pkt->stream_index];
+    int64_t t = av_rescale_q(packet_time(pkt), st->time_base, AV_TIME_BASE_Q);
+    
+    if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
+        if (cmaf->segment_start < 0) {
+            cmaf->segment_start = cmaf->chunk_start = t;
+        } else if ((pkt->flags & AV_PKT_FLAG_KEY) &&
+                   t - cmaf->segment_start >= cmaf->segment_duration) {
+            cmaf_flush_chunk(oc, cmaf);
+            cmaf_publish_segment(cmaf);
+            cmaf->segment_start = cmaf->chunk_start = t;
+        } else if (t - cmaf->chunk_start >= cmaf->chunk_duration) {
+            cmaf_flush_chunk(oc, cmaf);
+            cmaf->chunk_start = t;
+        }
+    }
+    if (!cmaf->chunk_open) {
+        cmaf->chunk_open = true;
+        cmaf->chunk_wall_start = av_gettime_relative();
+    }
+}
+
+/* Set up fragmented mp4 output. Must be called after the codecs are
+ * opened and before avformat_write_header, which then writes the init
+ * segment (ftyp + empty moov). */
+static CmafOutput *cmaf_open(AVFormatContext *oc, const char *filename, double segment_seconds,
+                             int chunk_ms, AVDictionary **opt)
+{
+    CmafOutput *cmaf = new CmafOutput();
+    std::string name(filename);
+    size_t dot = name.rfind('.');
+    
+    cmaf->sink = AvioSink::openMemory(0);
+    if (!cmaf->sink) {
+        fprintf(stderr, "Could not allocate the CMAF output buffer\n");
+        exit(1);
+    }
+    // a live origin cannot seek back, neither can we
+    cmaf->sink->context()->seekable = 0;
+    oc->pb = cmaf->sink->context();
+    
+    cmaf->prefix           = dot == std::string::npos ? name : name.substr(0, dot);
+    cmaf->segment_duration = (int64_t)(segment_seconds * AV_TIME_BASE);
+    cmaf->chunk_duration   = (int64_t)chunk_ms * 1000;
+    cmaf->segment_start    = -1;
+    cmaf->chunk_start      = -1;
+    
+    av_dict_set(opt, "movflags", "frag_custom+empty_moov+default_base_moof", 0);
+    return cmaf;
+}
+
+static void cmaf_write_init(CmafOutput *cmaf)
+{
+    std::vector<uint8_t> init;
+    
+    avio_flush(cmaf->sink->context());
+    cmaf->sink->takeBuffer(init);
+    if (publish_file(cmaf->prefix + "_init.mp4", init.data(), init.size()) < 0) {
+        fprintf(stderr, "Could not publish %s_init.mp4\n", cmaf->prefix.c_str());
+        exit(1);
+    }
+    cmaf->start_time = av_gettime_relative();
+}
+
+// flush the last chunk, publish the last segment and print the latency report
+static void cmaf_close(AVFormatContext *oc, CmafOutput *cmaf)
+{
+    std::vector<uint8_t> trailer;
+    
+    cmaf_flush_chunk(oc, cmaf);
+    cmaf_publish_segment(cmaf);
+    
+    // the mfra index written by the trailer is of no use to a segmented stream
+    av_write_trailer(oc);
+    avio_flush(oc->pb);
+    cmaf->sink->takeBuffer(trailer);
+    
+    fprintf(stderr, "CMAF: %d segments, %d chunks, time to first byte %.1f ms, "
+            "chunk latency avg %.1f ms max %.1f ms\n",
+            cmaf->segment_index, cmaf->nb_chunks,
+            (cmaf->first_byte_time - cmaf->start_time) / 1000.0,
+            cmaf->nb_chunks ? cmaf->chunk_latency_sum / 1000.0 / cmaf->nb_chunks : 0.0,
+            cmaf->chunk_latency_max / 1000.0);
+    
+    delete cmaf->sink;
+    oc->pb = NULL;
+    delete cmaf;
+}
+
+/**************************************************************/
+/* parallel encoding */
+
+/* Each encoder thread feeds its stream's packets in dts order, and the
+ * interleaver hands them out in global dts order, the same choice the
+ * serial loop makes with av_compare_ts. They are written with
+ * av_write_frame, so the interleaver's budget is all the packet memory
+ * there is and nothing is held back across a CMAF chunk boundary. */
+static void mux_queued_packets(AVFormatContext *oc, PacketInterleaver *interleaver, CmafOutput *cmaf)
+{
+    AVPacket *pkt;
+    int ret;
+    
+    while ((pkt = interleaver->pop())) {
+        log_packet(oc, pkt);
+        if (cmaf)
+            cmaf_before_packet(oc, cmaf, pkt);
+        tee_packet(oc, pkt);
+        ret = av_write_frame(oc, pkt);
+        if (ret < 0) {
+            fprintf(stderr, "Error while writing output packet: %s\n", av_err2str(ret));
+            exit(1);
+        }
+        av_free_packet(pkt);
+        av_free(pkt);
+    }
+}
+
+/* Encoder thread body: encode until the stream ends, paced to the wall
+ * clock in real-time mode. Only video frames are ever dropped; their pts
+ * still advance, so video stays in sync with the uninterrupted audio. */
+static void encode_stream(AVFormatContext *oc, OutputStream *ost, int is_video)
+{
+    AVCodecContext *c = ost->st->codec;
+    int (*write_fn)(AVFormatContext *, OutputStream *) = is_video ? write_video_frame : write_audio_frame;
+    
+    for (;;) {
+        int64_t now, due, duration;
+        int done;
+        
+        if (realtime) {
+            duration = av_rescale_q(is_video ? 1 : ost->frame->nb_samples, c->time_base, AV_TIME_BASE_Q);
+            due = realtime_start + av_rescale_q(ost->next_pts, c->time_base, AV_TIME_BASE_Q);
+            now = av_gettime_relative();
+            if (now < due) {
+                av_usleep(due - now);
+                now = due;
+            } else if (is_video && realtime_drop >= 0 && now - due > realtime_drop * duration) {
+                ost->next_pts++;
+                ost->rt_dropped++;
+                continue;
+            }
+        }
+        
+        done = write_fn(oc, ost);
+        if (done < 0)
+            exit(1);
+        if (done)
+            break;
+        
+        if (realtime) {
+            double load = (double)(av_gettime_relative() - now) / duration;
+            ost->rt_frames++;
+            ost->rt_load_sum += load;
+            ost->rt_load_max = FFMAX(ost->rt_load_max, load);
+            if (load > 1)
+                ost->rt_over_budget++;
+        }
+    }
+    ost->interleaver->finish(ost->interleave_index);
+}
+
+static void print_realtime_stats(const char *name, const OutputStream *ost)
+{
+    fprintf(stderr, "%s: %d frames, %d dropped, load avg %.0f%% max %.0f%%, %d over budget\n",
+            name, ost->rt_frames, ost->rt_dropped,
+            ost->rt_frames ? 100 * ost->rt_load_sum / ost->rt_frames : 0.0,
+            100 * ost->rt_load_max, ost->rt_over_budget);
+}
+
+/* Generate and encode every stream on its own thread while the calling
+ * thread muxes, so the encoders overlap. */
+static void encode_streams_parallel(AVFormatContext *oc, OutputStream **streams, int nb_streams,
+                                    size_t mux_budget, int64_t max_delta, CmafOutput *cmaf)
+{
+    PacketInterleaver interleaver(nb_streams, mux_budget, max_delta);
+    std::vector<std::thread> encoders;
+    int i;
+    
+    for (i = 0; i < nb_streams; i++) {
+        streams[i]->interleaver      = &interleaver;
+        streams[i]->interleave_index = i;
+        interleaver.setTimeBase(i, streams[i]->st->time_base);
+    }
+    // the common clock all streams are paced against in real-time mode
+    realtime_start = av_gettime_relative();
+    for (i = 0; i < nb_streams; i++) {
+        OutputStream *ost = streams[i];
+        int is_video = ost->st->codec->codec_type == AVMEDIA_TYPE_VIDEO;
+        
+        encoders.push_back(std::thread([oc, ost, is_video]() { encode_stream(oc, ost, is_video); }));
+    }
+    
+    mux_queued_packets(oc, &interleaver, cmaf);
+    
+    for (i = 0; i < nb_streams; i++) {
+        encoders[i].join();
+        streams[i]->interleaver = NULL;
+    }
+    interleaver.printStats(stderr);
+}
+
+/**************************************************************/
+/* load generator */
+
+// frames a session encodes per turn before it yields its worker
+#define LOAD_FRAMES_PER_STEP 8
+
+/* One independent output with its own audio and video stream. A session
+ * is a cooperative task: every turn it encodes a few frames with the
+ * serial muxing loop and then queues its next turn, so hundreds of them
+ * share a small worker pool. In real-time mode a session that is ahead of
+ * the clock is parked in the timer list instead of blocking a worker. */
+struct LoadSession {
+    int index;
+    std::string url;
+    const StreamProfile *profile;
+    AVFormatContext *oc;
+    OutputStream video_st, audio_st;
+    int encode_video, encode_audio;
+    int64_t start, end;         // wall clock
+    int64_t bytes;
+    int frames;
+    int failed;
+};
+
+struct LoadGenerator {
+    ThreadPool *pool;
+    const char *format;
+    std::vector<LoadSession *> sessions;
+    
+    std::mutex mutex;
+    std::condition_variable timer_cond, done_cond;
+    std::multimap<int64_t, LoadSession *> timers;   // wall clock -> parked session
+    int running;
+    bool stopping;
+};
+
+static void load_session_step(LoadGenerator *gen, LoadSession *s);
+
+static void load_schedule(LoadGenerator *gen, LoadSession *s)
+{
+    gen->pool->submit([gen, s]() { load_session_step(gen, s); });
+}
+
+// runs parked sessions when they are due
+static void load_timer_thread(LoadGenerator *gen)
+{
+    std::unique_lock<std::mutex> lock(gen->mutex);
+    
+    while (!gen->stopping) {
+        if (gen->timers.empty()) {
+            gen->timer_cond.wait(lock);
+            continue;
+        }
+        int64_t due = gen->timers.begin()->first;
+        int64_t now = av_gettime_relative();
+        if (due > now) {
+            gen->timer_cond.wait_for(lock, std::chrono::microseconds(due - now));
+            continue;
+        }
+        LoadSession *s = gen->timers.begin()->second;
+        gen->timers.erase(gen->timers.begin());
+        lock.unlock();
+        load_schedule(gen, s);
+        lock.lock();
+    }
+}
+
+static void load_session_finish(LoadGenerator *gen, LoadSession *s)
+{
+    s->end = av_gettime_relative();
+    {
+        std::lock_guard<std::mutex> lock(gen->mutex);
+        gen->running--;
+    }
+    gen->done_cond.notify_all();
+}
+
+static int load_session_open(LoadGenerator *gen, LoadSession *s)
+{
+    AVCodec *audio_codec, *video_codec;
+    AVOutputFormat *fmt;
+    int ret;
+    
+    avformat_alloc_output_context2(&s->oc, NULL, gen->format, s->url.c_str());
+    if (!s->oc)
+        avformat_alloc_output_context2(&s->oc, NULL, "mpegts", s->url.c_str());
+    if (!s->oc)
+        return AVERROR(ENOMEM);
+    fmt = s->oc->oformat;
+    
+    if (fmt->video_codec != AV_CODEC_ID_NONE) {
+        if ((ret = add_stream(&s->video_st, s->oc, &video_codec, fmt->video_codec, s->profile)) < 0)
+            return ret;
+        s->encode_video = 1;
+    }
+    if (fmt->audio_codec != AV_CODEC_ID_NONE) {
+        if ((ret = add_stream(&s->audio_st, s->oc, &audio_codec, fmt->audio_codec, s->profile)) < 0)
+            return ret;
+        s->encode_audio = 1;
+    }
+    if (s->encode_video && (ret = open_video(s->oc, video_codec, &s->video_st, NULL)) < 0)
+        return ret;
+    if (s->encode_audio && (ret = open_audio(s->oc, audio_codec, &s->audio_st, NULL)) < 0)
+        return ret;
+    
+    if (!(fmt->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&s->oc->pb, s->url.c_str(), AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            fprintf(stderr, "Session %d: could not open '%s': %s\n", s->index, s->url.c_str(), av_err2str(ret));
+            return ret;
+        }
+    }
+    ret = avformat_write_header(s->oc, NULL);
+    if (ret < 0) {
+        fprintf(stderr, "Session %d: could not write header: %s\n", s->index, av_err2str(ret));
+        return ret;
+    }
+    s->start = av_gettime_relative();
+    return 0;
+}
+
+static void load_session_close(LoadSession *s)
+{
+    if (s->oc->pb && !s->failed)
+        av_write_trailer(s->oc);
+    if (s->video_st.st)
+        close_stream(s->oc, &s->video_st);
+    if (s->audio_st.st)
+        close_stream(s->oc, &s->audio_st);
+    if (s->oc->pb) {
+        s->bytes = avio_tell(s->oc->pb);
+        if (!(s->oc->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&s->oc->pb);
+    }
+    avformat_free_context(s->oc);
+    s->oc = NULL;
+}
+
+// one turn of a session; a session that fails is closed, the others carry on
+static void load_session_step(LoadGenerator *gen, LoadSession *s)
+{
+    int n, ret;
+    
+    if (!s->oc) {
+        if (load_session_open(gen, s) < 0) {
+            s->failed = 1;
+            if (s->oc)
+                load_session_close(s);
+            load_session_finish(gen, s);
+            return;
+        }
+    }
+    
+    for (n = 0; n < LOAD_FRAMES_PER_STEP && (s->encode_video || s->encode_audio); n++) {
+        /* select the stream to encode, as in the single output loop */
+        OutputStream *ost = s->encode_video &&
+            (!s->encode_audio || av_compare_ts(s->video_st.next_pts, s->video_st.st->codec->time_base,
+                                               s->audio_st.next_pts, s->audio_st.st->codec->time_base) <= 0)
+            ? &s->video_st : &s->audio_st;
+        
+        if (realtime) {
+            int64_t due = s->start + av_rescale_q(ost->next_pts, ost->st->codec->time_base, AV_TIME_BASE_Q);
+            if (due > av_gettime_relative()) {
+                {
+                    std::lock_guard<std::mutex> lock(gen->mutex);
+                    gen->timers.insert(std::make_pair(due, s));
+                }
+                gen->timer_cond.notify_one();
+                return;
+            }
+        }
+        
+        ret = ost == &s->video_st ? write_video_frame(s->oc, ost) : write_audio_frame(s->oc, ost);
+        if (ret < 0) {
+            fprintf(stderr, "Session %d: failed after %d frames: %s\n", s->index, s->frames, av_err2str(ret));
+            s->failed = 1;
+            load_session_close(s);
+            load_session_finish(gen, s);
+            return;
+        }
+        if (ost == &s->video_st)
+            s->encode_video = !ret;
+        else
+            s->encode_audio = !ret;
+        s->frames++;
+    }
+    
+    if (s->encode_video || s->encode_audio) {
+        load_schedule(gen, s);
+        return;
+    }
+    load_session_close(s);
+    load_session_finish(gen, s);
+}
+
+/* Run nb_sessions outputs on nb_workers threads. url_template may contain
+ * %d for the session number, e.g. out_%d.ts; without it every session
+ * opens the same URL, e.g. tcp://127.0.0.1:9000 for a listening packager.
+ * Profiles are assigned round robin. */
+static int run_load(const char *url_template, const char *format, int nb_sessions,
+                    const std::vector<StreamProfile>& profiles, int nb_workers)
+{
+    LoadGenerator gen;
+    std::thread timer;
+    int64_t start, elapsed, bytes = 0;
+    long frames = 0;
+    int i, failed = 0;
+    double slowest = 0;
+    
+    avformat_network_init();
+    // sessions open codecs concurrently
+    if (av_lockmgr_register(mutex_lock_manager) < 0) {
+        fprintf(stderr, "Could not register the lock manager\n");
+        return 1;
+    }
+    log_packets = 0;
+    
+    gen.pool     = new ThreadPool(nb_workers);
+    gen.format   = format;
+    gen.running  = nb_sessions;
+    gen.stopping = false;
+    for (i = 0; i < nb_sessions; i++) {
+        LoadSession *s = new LoadSession();
+        char url[1024];
+        
+        if (strstr(url_template, "%d"))
+            snprintf(url, sizeof(url), url_template, i);
+        else
+            snprintf(url, sizeof(url), "%s", url_template);
+        s->index   = i;
+        s->url     = url;
+        s->profile = &profiles[i % profiles.size()];
+        gen.sessions.push_back(s);
+    }
+    fprintf(stderr, "Starting %d sessions on %d workers\n", nb_sessions, gen.pool->size());
+    
+    start = av_gettime_relative();
+    timer = std::thread(load_timer_thread, &gen);
+    for (i = 0; i < nb_sessions; i++)
+        load_schedule(&gen, gen.sessions[i]);
+    
+    {
+        std::unique_lock<std::mutex> lock(gen.mutex);
+        gen.done_cond.wait(lock, [&gen]() { return gen.running == 0; });
+        gen.stopping = true;
+    }
+    gen.timer_cond.notify_all();
+    timer.join();
+    gen.pool->wait();
+    elapsed = FFMAX(av_gettime_relative() - start, 1);
+    
+    for (i = 0; i < nb_sessions; i++) {
+        LoadSession *s = gen.sessions[i];
+        if (s->failed) {
+            failed++;
+        } else {
+            frames += s->frames;
+            bytes  += s->bytes;
+            // wall time needed per second of media, > 1 means slower than real time
+            slowest = FFMAX(slowest, (s->end - s->start) / (s->profile->duration * AV_TIME_BASE));
+        }
+        delete s;
+    }
+    delete gen.pool;
+    av_lockmgr_register(NULL);
+    
+    fprintf(stderr, "%d sessions (%d failed) in %.2fs: %ld frames (%.0f/s), %.1f MB (%.1f Mbit/s), "
+            "slowest session %.2fx real time\n",
+            nb_sessions, failed, elapsed / 1000000.0, frames, frames * 1000000.0 / elapsed,
+            bytes / 1e6, bytes * 8.0 / elapsed, slowest);
+    return failed ? 1 : 0;
+}
+
+/* encoder:WxH:bitrate[,...], e.g. libx264:640x360:800k,mpeg4:352x288:400k;
+ * "default" as the encoder name keeps the format's default codec */
+static int parse_profiles(const char *spec, double duration, std::vector<StreamProfile> *profiles)
+{
+    std::string list(spec);
+    size_t pos = 0;
+    
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos);
+        std::string item = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        size_t c1 = item.find(':'), c2 = c1 == std::string::npos ? c1 : item.find(':', c1 + 1);
+        StreamProfile p = default_profile;
+        std::string size, rate;
+        char *end;
+        
+        if (c2 == std::string::npos)
+            return AVERROR(EINVAL);
+        size = item.substr(c1 + 1, c2 - c1 - 1);
+        rate = item.substr(c2 + 1);
+        // the name has to outlive the profile list, the sessions keep pointing at it
+        if (item.compare(0, c1, "default"))
+            p.video_encoder = av_strdup(item.substr(0, c1).c_str());
+        if (av_parse_video_size(&p.width, &p.height, size.c_str()) < 0)
+            return AVERROR(EINVAL);
+        p.video_bit_rate = (int)strtol(rate.c_str(), &end, 10);
+        if (*end == 'k' || *end == 'K')
+            p.video_bit_rate *= 1000;
+        else if (*end == 'M')
+            p.video_bit_rate *= 1000000;
+        p.duration = duration;
+        // many sessions share the cores already, one thread per codec
+        p.threads  = 1;
+        profiles->push_back(p);
+        
+        if (comma == std::string::npos)
+            break;
+        pos = comma + 1;
+    }
+    return profiles->empty() ? AVERROR(EINVAL) : 0;
+}
+
 /**************************************************************/
 /* media file output */
 
 int main(int argc, char **argv)
 {
-    OutputStream video_st = { 0 }, audio_st = { 0 };
+    OutputStream video_st = { 0 }, audio_st[MAX_AUDIO_TRACKS] = { { 0 } };
+    OutputStream *streams[MAX_AUDIO_TRACKS + 1];
+    int nb_streams = 0, audio_tracks = 1;
+    long mux_budget = MUX_MEMORY_BUDGET;
+    int max_delta_ms = MUX_MAX_DELTA_MS;
+    std::vector<const char *> tee_files;
     const char *filename;
     AVOutputFormat *fmt;
     AVFormatContext *oc;
@@ -595,29 +1560,119 @@ int main(int argc, char **argv)
     int ret;
     int have_video = 0, have_audio = 0;
     int encode_video = 0, encode_audio = 0;
+    int tee_failed = 0;
     AVDictionary *opt = NULL;
+    const char *avio_mode = "default";
+    long avio_buffer = 0;
+    AvioSink *sink = NULL;
+    double cmaf_segment = 0;
+    int cmaf_chunk_ms = CMAF_CHUNK_MS;
+    CmafOutput *cmaf = NULL;
+    int load_sessions = 0, load_workers = 0;
+    const char *load_profiles = "default:352x288:400k";
+    const char *load_format = NULL;
+    double load_duration = STREAM_DURATION;
+    int64_t start;
+    int i;
     
     /* Initialize libavcodec, and register all codecs and formats. */
     av_register_all();
     
     if (argc < 2) {
-        printf("usage: %s output_file\n"
+        printf("usage: %s output_file [-flags flags] [-avio default|file|memory|mmap] [-avio_buffer bytes]\n"
+               "       [-cmaf segment_seconds] [-cmaf_chunk ms] [-audio_src native|s16]\n"
+               "       [-realtime drop_after] [-audio_tracks n] [-mux_budget bytes] [-max_delta ms]\n"
+               "       [-tee extra_output]...\n"
+               "       %s url_template -load sessions [-profiles encoder:WxH:bitrate,...]\n"
+               "       [-workers threads] [-load_duration seconds] [-load_format format]\n"
                "API example program to output a media file with libavformat.\n"
                "This program generates a synthetic audio and video stream, encodes and\n"
                "muxes them into a file named output_file.\n"
                "The output format is automatically guessed according to the file extension.\n"
                "Raw images can also be output by using '%%d' in the filename.\n"
-               "\n", argv[0]);
+               "-avio selects how the output is written: avio_open (default), a file with\n"
+               "a large coalescing buffer (file), entirely in memory and stored in one\n"
+               "write at the end (memory), or through a memory mapped file (mmap).\n"
+               "-avio_buffer is the buffer size for file and the initial size for memory/mmap.\n"
+               "-cmaf writes fragmented mp4 instead: output_init.mp4 plus output_NNNNN.m4s\n"
+               "segments of about segment_seconds, each made of chunks of -cmaf_chunk ms.\n"
+               "-audio_src s16 generates interleaved S16 audio and converts it for the encoder\n"
+               "instead of generating the encoder's sample format directly.\n"
+               "-realtime paces generation to the wall clock and drops video frames that are\n"
+               "more than drop_after frame periods late (-1: never); audio is never dropped.\n"
+               "-audio_tracks adds that many audio streams. Packets are interleaved in at most\n"
+               "-mux_budget bytes; streams more than -max_delta ms apart are not waited for.\n"
+               "-tee also muxes the same encoded packets into extra_output, in the container\n"
+               "its extension selects; it can be given several times. A slow extra output slows\n"
+               "the run down; with -realtime it loses packets up to the next keyframe instead,\n"
+               "and any loss or write error makes the exit status non-zero.\n"
+               "-load runs that many independent outputs at once on a pool of -workers\n"
+               "threads. %%d in url_template is replaced by the session number; without it\n"
+               "every session opens the same URL, e.g. tcp://127.0.0.1:9000. Profiles are\n"
+               "assigned round robin, 'default' keeps the format's video codec.\n"
+               "\n", argv[0], argv[0]);
         return 1;
     }
     
     filename = argv[1];
-    if (argc > 3 && !strcmp(argv[2], "-flags")) {
-        av_dict_set(&opt, argv[2]+1, argv[3], 0);
+    for (i = 2; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-flags")) {
+            av_dict_set(&opt, argv[i]+1, argv[i+1], 0);
+        } else if (!strcmp(argv[i], "-avio")) {
+            avio_mode = argv[i+1];
+        } else if (!strcmp(argv[i], "-avio_buffer")) {
+            avio_buffer = atol(argv[i+1]);
+        } else if (!strcmp(argv[i], "-cmaf")) {
+            cmaf_segment = atof(argv[i+1]);
+        } else if (!strcmp(argv[i], "-cmaf_chunk")) {
+            cmaf_chunk_ms = atoi(argv[i+1]);
+        } else if (!strcmp(argv[i], "-audio_src")) {
+            audio_source_s16 = !strcmp(argv[i+1], "s16");
+        } else if (!strcmp(argv[i], "-realtime")) {
+            realtime = 1;
+            realtime_drop = atof(argv[i+1]);
+        } else if (!strcmp(argv[i], "-audio_tracks")) {
+            audio_tracks = atoi(argv[i+1]);
+            if (audio_tracks < 1 || audio_tracks > MAX_AUDIO_TRACKS) {
+                fprintf(stderr, "-audio_tracks must be between 1 and %d\n", MAX_AUDIO_TRACKS);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "-tee")) {
+            tee_files.push_back(argv[i+1]);
+        } else if (!strcmp(argv[i], "-mux_budget")) {
+            mux_budget = atol(argv[i+1]);
+        } else if (!strcmp(argv[i], "-max_delta")) {
+            max_delta_ms = atoi(argv[i+1]);
+        } else if (!strcmp(argv[i], "-load")) {
+            load_sessions = atoi(argv[i+1]);
+        } else if (!strcmp(argv[i], "-profiles")) {
+            load_profiles = argv[i+1];
+        } else if (!strcmp(argv[i], "-workers")) {
+            load_workers = atoi(argv[i+1]);
+        } else if (!strcmp(argv[i], "-load_duration")) {
+            load_duration = atof(argv[i+1]);
+        } else if (!strcmp(argv[i], "-load_format")) {
+            load_format = argv[i+1];
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    
+    if (load_sessions > 0) {
+        std::vector<StreamProfile> profiles;
+        if (parse_profiles(load_profiles, load_duration, &profiles) < 0) {
+            fprintf(stderr, "Invalid profile list '%s'\n", load_profiles);
+            return 1;
+        }
+        return run_load(filename, load_format, load_sessions, profiles, load_workers);
     }
     
     /* allocate the output media context */
-    avformat_alloc_output_context2(&oc, NULL, NULL, filename);
+    if (cmaf_segment > 0)
+        avformat_alloc_output_context2(&oc, NULL, "mp4", filename);
+    else
+        avformat_alloc_output_context2(&oc, NULL, NULL, filename);
     if (!oc) {
         printf("Could not deduce output format from file extension: using MPEG.\n");
         avformat_alloc_output_context2(&oc, NULL, "mpeg", filename);
@@ -627,39 +1682,70 @@ int main(int argc, char **argv)
     
     fmt = oc->oformat;
     
+    tee_source = oc;
+    for (i = 0; i < (int)tee_files.size(); i++)
+        tee_alloc(tee_files[i]);
+    
     /* Add the audio and video streams using the default format codecs
      * and initialize the codecs. */
     if (fmt->video_codec != AV_CODEC_ID_NONE) {
-        add_stream(&video_st, oc, &video_codec, fmt->video_codec);
+        if (add_stream(&video_st, oc, &video_codec, fmt->video_codec, &default_profile) < 0)
+            exit(1);
         have_video = 1;
         encode_video = 1;
     }
     if (fmt->audio_codec != AV_CODEC_ID_NONE) {
-        add_stream(&audio_st, oc, &audio_codec, fmt->audio_codec);
-        have_audio = 1;
+        for (i = 0; i < audio_tracks; i++) {
+            if (add_stream(&audio_st[i], oc, &audio_codec, fmt->audio_codec, &default_profile) < 0)
+                exit(1);
+        }
+        have_audio = audio_tracks;
         encode_audio = 1;
     }
     
     /* Now that all the parameters are set, we can open the audio and
      * video codecs and allocate the necessary encode buffers. */
-    if (have_video)
-        open_video(oc, video_codec, &video_st, opt);
+    if (have_video && open_video(oc, video_codec, &video_st, opt) < 0)
+        exit(1);
     
-    if (have_audio)
-        open_audio(oc, audio_codec, &audio_st, opt);
+    for (i = 0; i < have_audio; i++) {
+        if (open_audio(oc, audio_codec, &audio_st[i], opt) < 0)
+            exit(1);
+    }
     
     av_dump_format(oc, 0, filename, 1);
     
     /* open the output file, if needed */
-    if (!(fmt->flags & AVFMT_NOFILE)) {
-        //以写的方式打开文件
-        ret = avio_open(&oc->pb, filename, AVIO_FLAG_WRITE);
-        if (ret < 0) {
-            fprintf(stderr, "Could not open '%s': %s\n", filename,
-                    av_err2str(ret));
+    if (cmaf_segment > 0) {
+        cmaf = cmaf_open(oc, filename, cmaf_segment, cmaf_chunk_ms, &opt);
+    } else if (!(fmt->flags & AVFMT_NOFILE)) {
+        if (!strcmp(avio_mode, "file")) {
+            sink = AvioSink::openFile(filename, avio_buffer > 0 ? avio_buffer : AVIO_SINK_DEFAULT_BUFFER);
+        } else if (!strcmp(avio_mode, "memory")) {
+            sink = AvioSink::openMemory(avio_buffer > 0 ? avio_buffer : 0);
+        } else if (!strcmp(avio_mode, "mmap")) {
+            sink = AvioSink::openMmap(filename, avio_buffer > 0 ? avio_buffer : 0);
+        } else if (strcmp(avio_mode, "default")) {
+            fprintf(stderr, "Unknown output backend '%s'\n", avio_mode);
             return 1;
         }
+        
+        if (sink) {
+            oc->pb = sink->context();
+        } else if (strcmp(avio_mode, "default")) {
+            fprintf(stderr, "Could not open '%s' for %s output\n", filename, avio_mode);
+            return 1;
+        } else {
+            //以写的方式打开文件
+            ret = avio_open(&oc->pb, filename, AVIO_FLAG_WRITE);
+            if (ret < 0) {
+                fprintf(stderr, "Could not open '%s': %s\n", filename,
+                        av_err2str(ret));
+                return 1;
+            }
+        }
     }
+    start = av_gettime_relative();
     
     /* Write the stream header, if any. */
     //写视频的文件头
@@ -669,37 +1755,96 @@ int main(int argc, char **argv)
                 av_err2str(ret));
         return 1;
     }
+    if (cmaf)
+        cmaf_write_init(cmaf);
+    tee_open(oc);
+    
+    /* Raw picture packets point into the reused frame and cannot wait in
+     * a queue, so those formats keep the serial loop. */
+    if (!(fmt->flags & AVFMT_RAWPICTURE)) {
+        if (have_video)
+            streams[nb_streams++] = &video_st;
+        for (i = 0; i < have_audio; i++)
+            streams[nb_streams++] = &audio_st[i];
+        encode_streams_parallel(oc, streams, nb_streams, mux_budget, (int64_t)max_delta_ms * 1000, cmaf);
+        encode_video = encode_audio = 0;
+        if (realtime && have_video)
+            print_realtime_stats("video", &video_st);
+        for (i = 0; realtime && i < have_audio; i++)
+            print_realtime_stats("audio", &audio_st[i]);
+    } else {
+        if (realtime)
+            fprintf(stderr, "Real-time mode is not available for raw picture output\n");
+        if (have_audio > 1)
+            fprintf(stderr, "Only the first audio track is encoded for raw picture output\n");
+    }
     
     while (encode_video || encode_audio) {
         /* select the stream to encode */
         //如果视频的时间戳 小于 音频的时间戳
         if (encode_video &&
             (!encode_audio || av_compare_ts(video_st.next_pts, video_st.st->codec->time_base,
-                                            audio_st.next_pts, audio_st.st->codec->time_base) <= 0)) {
-            encode_video = !write_video_frame(oc, &video_st);
+                                            audio_st[0].next_pts, audio_st[0].st->codec->time_base) <= 0)) {
+            ret = write_video_frame(oc, &video_st);
+            encode_video = !ret;
         } else {
-            encode_audio = !write_audio_frame(oc, &audio_st);
+            ret = write_audio_frame(oc, &audio_st[0]);
+            encode_audio = !ret;
         }
+        if (ret < 0)
+            exit(1);
     }
     
     /* Write the trailer, if any. The trailer must be written before you
      * close the CodecContexts open when you wrote the header; otherwise
      * av_write_trailer() may try to use memory that was freed on
      * av_codec_close(). */
-    av_write_trailer(oc);
+    if (cmaf)
+        cmaf_close(oc, cmaf);
+    else
+        av_write_trailer(oc);
+    tee_failed = tee_close() < 0;
+    
+    if (sink) {
+        if (sink->finish() < 0) {
+            fprintf(stderr, "Error while flushing '%s'\n", filename);
+            return 1;
+        }
+        fprintf(stderr, "%s output: %.1f ms, %ld AVIO writes, %ld write() calls\n",
+                avio_mode, (av_gettime_relative() - start) / 1000.0,
+                sink->writeCalls(), sink->syscalls());
+        if (sink->mode() == AvioSink::MEMORY_SINK) {
+            /* The finished file is now owned by the caller; this example
+             * just stores it so that the result can be played. */
+            std::vector<uint8_t> bytes;
+            FILE *f;
+            sink->takeBuffer(bytes);
+            fprintf(stderr, "Muxed %zu bytes in memory\n", bytes.size());
+            f = fopen(filename, "wb");
+            if (!f || fwrite(bytes.data(), 1, bytes.size(), f) != bytes.size()) {
+                fprintf(stderr, "Could not write '%s'\n", filename);
+                return 1;
+            }
+            fclose(f);
+        }
+    }
     
     /* Close each codec. */
     if (have_video)
         close_stream(oc, &video_st);
-    if (have_audio)
-        close_stream(oc, &audio_st);
-    
-    if (!(fmt->flags & AVFMT_NOFILE))
+    for (i = 0; i < have_audio; i++)
+        close_stream(oc, &audio_st[i]);
+    
+    if (sink) {
+        /* the sink owns oc->pb */
+        delete sink;
+        oc->pb = NULL;
+    } else if (!(fmt->flags & AVFMT_NOFILE) && oc->pb)
     /* Close the output file. */
         avio_closep(&oc->pb);
     
     /* free the stream */
     avformat_free_context(oc);
     
-    return 0;
+    return tee_failed ? 1 : 0;
 }
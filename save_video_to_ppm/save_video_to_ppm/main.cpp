@@ -16,39 +16,49 @@ extern "C"
 #ifdef __cplusplus
 }
 #endif
-static void SaveFrame(AVFrame* pFrame, int width, int height, int iFrame)
+#include "../../common/slice_sws.h"
+#include "../../common/image_sink.h"
+
+//P6头部最长的长度 "P6\n%d %d\n255\n"
+#define PPM_HEADER_MAX 32
+
+static void SaveFrame(ImageSink* sink, AVFrame* pFrame, int width, int height, const char *prefix, int iFrame)
 {
-    FILE *pFile;
-    char szFilename[32];
+    char szFilename[64];
     int y;
     
-    //Open file
-    sprintf(szFilename, "frame%d.ppm", iFrame);
-    pFile = fopen(szFilename, "wb");
-    if (pFile == NULL) {
-        fprintf(stderr, "Could not open the ppm file.\n");
-        return;
-    }
+    //头部和像素拼接到同一块缓冲区，由后台线程一次 write 写入
+    //Blocks here only when every buffer is still waiting for the disk
+    uint8_t *buf = sink->acquire();
+    
     //Write header
-    fprintf(pFile, "P6\n%d %d\n255\n", width, height);
+    int size = snprintf((char *)buf, PPM_HEADER_MAX, "P6\n%d %d\n255\n", width, height);
     
     //Write pixel data
     for (y = 0; y < height; ++y) {
-        fwrite(pFrame->data[0] + y*pFrame->linesize[0], 1, width*3, pFile);
+        memcpy(buf + size, pFrame->data[0] + y*pFrame->linesize[0], width*3);
+        size += width*3;
     }
     
-    fclose(pFile);
+    snprintf(szFilename, sizeof(szFilename), "%s%d.ppm", prefix, iFrame);
+    sink->commit(buf, size, szFilename);
 }
-int main(int argc, char *argv[])
+//解码一个文件，保存前100帧为 <prefix>N.ppm
+//批量处理时每个文件都会走一遍，所以每条路径都要释放全部资源
+static int SaveVideoFrames(const char *filename, const char *prefix)
 {
-    av_register_all();
-    
     AVFormatContext *pFormatCtx = NULL;
+    AVCodecContext *pCodecCtx = NULL;
+    AVCodec *pCodec = NULL;
+    AVFrame *pFrame = NULL, *pFrameRGB = NULL;
+    SliceSwsContext *img_convert_ctx = NULL;
+    int videoStream;
+    int ret = 1;
     
     //Open video file and allocate format context
     //读取文件的头部信息，并且保持这些信息到AVFormatContext中
     //如果AVFormatContext是NULL,这个函数将会同时申请一个空间
-    if (avformat_open_input(&pFormatCtx, argv[1], NULL, NULL) < 0) {
+    if (avformat_open_input(&pFormatCtx, filename, NULL, NULL) < 0) {
         av_log(pFormatCtx, AV_LOG_ERROR, "Could not open file.\n");
         return 1;
     }
@@ -56,46 +66,40 @@ int main(int argc, char *argv[])
     //这个函数为 pFormatCtx-streams填充正确的信息
     if (avformat_find_stream_info(pFormatCtx, NULL) < 0) {
         av_log(pFormatCtx, AV_LOG_ERROR, "Could not find stream info.\n");
-        return 1;
+        goto end;
     }
     
     //输出信息
-    av_dump_format(pFormatCtx, 0, argv[1], 0);
+    av_dump_format(pFormatCtx, 0, filename, 0);
     
     //找到视频流
-    int videoStream = 0;
     videoStream = av_find_best_stream(pFormatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
-    if (videoStream == -1) {
+    if (videoStream < 0) {
         av_log(pFormatCtx, AV_LOG_ERROR, "Could not find stream index.\n");
-        return 1;
+        goto end;
     }
     
-    AVCodecContext *pCodecCtx = NULL;
     pCodecCtx = pFormatCtx->streams[videoStream]->codec;
-    AVCodec *pCodec = NULL;
-    
-    pCodec =avcodec_find_decoder(pCodecCtx->codec_id);
+    pCodec = avcodec_find_decoder(pCodecCtx->codec_id);
     if (pCodec == NULL) {
-        av_log(pCodec, AV_LOG_ERROR, "Could not find decoder.\n");
-        return 1;
+        av_log(pCodecCtx, AV_LOG_ERROR, "Could not find decoder.\n");
+        goto end;
     }
     
     //open codec
     if (avcodec_open2(pCodecCtx, pCodec, NULL) < 0) {
         av_log(pCodecCtx, AV_LOG_ERROR, "Could open decoder.\n");
-        return 1;
+        goto end;
     }
     
-    AVFrame *pFrameRGB = NULL;
     pFrameRGB = av_frame_alloc();
-    if (!pFrameRGB) {
-        av_log(pFrameRGB , AV_LOG_ERROR, "Could allocate frame.\n");
-        return 1;
+    //用来存储解码后的原始数据
+    pFrame = av_frame_alloc();
+    if (!pFrameRGB || !pFrame) {
+        av_log(pCodecCtx, AV_LOG_ERROR, "Could allocate frame.\n");
+        goto end;
     }
     
-    uint8_t *buffer;
-    int numBytes = 0;
-    
     /*
         之前我们申请了一个 帧 对象，当转换的时候，我们仍然需要一个地方来放置原始的数据。
         我们使用avpicture_get_size来获取大小，然后av_malloc申请大小
@@ -106,48 +110,98 @@ int main(int argc, char *argv[])
 //    avpicture_fill((AVPicture*)pFrameRGB, buffer, PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height);
     
     //使用av_image_alloc代替上面注释的三行代码
-    av_image_alloc(pFrameRGB->data, pFrameRGB->linesize, pCodecCtx->width, pCodecCtx->height, PIX_FMT_RGB24, 1);
+    if (av_image_alloc(pFrameRGB->data, pFrameRGB->linesize, pCodecCtx->width, pCodecCtx->height, PIX_FMT_RGB24, 1) < 0) {
+        av_log(pCodecCtx, AV_LOG_ERROR, "Could not allocate the RGB image.\n");
+        goto end;
+    }
+    
+    //按行切成多个条带，多线程并行转换
+    img_convert_ctx = slice_sws_getContext(pCodecCtx->width, pCodecCtx->height, pCodecCtx->pix_fmt, pCodecCtx->width, pCodecCtx->height, PIX_FMT_RGB24, SWS_BILINEAR, 0);
+    if (!img_convert_ctx) {
+        av_log(pCodecCtx, AV_LOG_ERROR, "Could not create the conversion context.\n");
+        goto end;
+    }
+    //按照解码器给出的色彩空间转换，设置失败时颜色会错，整个文件按失败处理
+    if (slice_sws_setColorspace(img_convert_ctx,
+                                pCodecCtx->colorspace == AVCOL_SPC_BT709 ? SWS_CS_ITU709 : SWS_CS_DEFAULT,
+                                pCodecCtx->color_range == AVCOL_RANGE_JPEG || pCodecCtx->pix_fmt == AV_PIX_FMT_YUVJ420P) < 0) {
+        av_log(pCodecCtx, AV_LOG_ERROR, "Could not set the colorspace of the conversion.\n");
+        goto end;
+    }
     
     //接下来，读入整个视频流，然后把它解码成帧，最后转换格式并且保存
-    int frameFinished;
-    AVPacket pkt;
-
-    //用来存储解码后的原始数据
-    AVFrame *pFrame = av_frame_alloc();
-    
-    int i = 0;
-    auto img_convert_ctx = sws_getContext(pCodecCtx->width, pCodecCtx->height, pCodecCtx->pix_fmt, pCodecCtx->width, pCodecCtx->height, PIX_FMT_RGB24, SWS_BILINEAR, NULL, NULL, NULL);
-    while (av_read_frame(pFormatCtx, &pkt) >= 0) {
-        //Is this a packet from the video stream?
-        if (pkt.stream_index == videoStream) {
-            //Decode video frame
-            //packet -----> frame
-            avcodec_decode_video2(pCodecCtx, pFrame, &frameFinished, &pkt);
-            if (frameFinished) {
-                sws_scale(img_convert_ctx, (const uint8_t* const*)pFrame->data, pFrame->linesize, 0, pCodecCtx->height, (uint8_t *const *)pFrameRGB->data, pFrameRGB->linesize);
-                if( ++i <= 100 )
-                    SaveFrame(pFrameRGB, pCodecCtx->width, pCodecCtx->height, i);
+    {
+        ImageSink sink(PPM_HEADER_MAX + pCodecCtx->width * pCodecCtx->height * 3);
+        int frameFinished;
+        AVPacket pkt;
+        int i = 0;
+        
+        while (av_read_frame(pFormatCtx, &pkt) >= 0) {
+            //Is this a packet from the video stream?
+            if (pkt.stream_index == videoStream) {
+                //Decode video frame
+                //packet -----> frame
+                avcodec_decode_video2(pCodecCtx, pFrame, &frameFinished, &pkt);
+                if (frameFinished) {
+                    slice_sws_scale(img_convert_ctx, (const uint8_t* const*)pFrame->data, pFrame->linesize, (uint8_t *const *)pFrameRGB->data, pFrameRGB->linesize);
+                    if( ++i <= 100 )
+                        SaveFrame(&sink, pFrameRGB, pCodecCtx->width, pCodecCtx->height, prefix, i);
+                }
             }
+            //其他流的包也要释放
             av_free_packet(&pkt);
         }
         
-        
+        //等待所有图片写完
+        sink.flush();
+        if (sink.errors())
+            av_log(NULL, AV_LOG_ERROR, "%d frames could not be saved.\n", sink.errors());
     }
-    sws_freeContext(img_convert_ctx);
+    ret = 0;
+    
+end:
+    slice_sws_freeContext(img_convert_ctx);
     
     //free the rgb image
-    //av_free(buffer);
-    av_free(pFrameRGB);
+    if (pFrameRGB)
+        av_freep(&pFrameRGB->data[0]);
+    av_frame_free(&pFrameRGB);
     
     //free the yuv frame
-    av_free(pFrame);
+    av_frame_free(&pFrame);
     
     //close the codec
-    avcodec_close(pCodecCtx);
+    if (pCodecCtx)
+        avcodec_close(pCodecCtx);
     
     //close the video file
     avformat_close_input(&pFormatCtx);
-    return 0;
+    return ret;
+}
+int main(int argc, char *argv[])
+{
+    char prefix[32];
+    int i, failed = 0;
+    
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s input_file [input_file...]\n", argv[0]);
+        return 1;
+    }
+    
+    av_register_all();
+    
+    //多个文件在同一个进程里处理，相同参数的 SwsContext 会从缓存中复用
+    for (i = 1; i < argc; ++i) {
+        if (argc == 2)
+            snprintf(prefix, sizeof(prefix), "frame");
+        else
+            snprintf(prefix, sizeof(prefix), "file%d_frame", i);
+        if (SaveVideoFrames(argv[i], prefix) != 0)
+            failed++;
+    }
+    
+    SwsContextCache::instance().printStats(stderr);
+    return failed ? 1 : 0;
 }
 
 
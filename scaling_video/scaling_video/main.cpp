@@ -45,11 +45,18 @@ extern "C"
 #endif
 #include "libavutil/imgutils.h"
 #include "libavutil/parseutils.h"
+#include "libavutil/time.h"
 #include "libswscale/swscale.h"
 #ifdef __cplusplus
 }
 #endif
-#define YUV_FILE_NAME "yuvout.yuv"
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include "../../common/slice_sws.h"
+#include "../../common/blocking_queue.h"
 static void fill_yuv_image( uint8_t *data[4], int linesize[4], int width, int height, int frame_index)
 {
     int x;
@@ -69,159 +76,668 @@ static void fill_yuv_image( uint8_t *data[4], int linesize[4], int width, int he
     }
 }
 
-static void saveYUV420P(unsigned char *buf, int wrap, int xsize, int ysize)
+/**************************************************************/
+/* scaler benchmark */
+
+// the algorithms we care about, in roughly increasing cost
+static const struct { const char *name; int flags; } bench_algos[] = {
+    { "fast_bilinear", SWS_FAST_BILINEAR },
+    { "bilinear",      SWS_BILINEAR      },
+    { "bicubic",       SWS_BICUBIC       },
+    { "area",          SWS_AREA          },
+    { "lanczos",       SWS_LANCZOS       },
+};
+static const char *bench_src_sizes[] = { "640x360", "1920x1080", "3840x2160" };
+static const char *bench_dst_sizes[] = { "320x180", "1280x720", "1920x1080" };
+static const enum AVPixelFormat bench_src_fmts[] = { AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_YUV422P, AV_PIX_FMT_RGB24 };
+static const enum AVPixelFormat bench_dst_fmts[] = { AV_PIX_FMT_RGB24, AV_PIX_FMT_YUV420P, AV_PIX_FMT_BGRA };
+
+// pixel format conversion at an unchanged size, to bring the pattern into other formats
+#define BENCH_CONVERT_FLAGS (SWS_POINT | SWS_ACCURATE_RND | SWS_FULL_CHR_H_INT | SWS_FULL_CHR_H_INP)
+
+#define ARRAY_ELEMS(a) (sizeof(a) / sizeof((a)[0]))
+
+/* A zone plate: the spatial frequency grows with the distance from the
+ * centre, so aliasing and blurring both cost PSNR, unlike the smooth
+ * gradient of fill_yuv_image.
+ *
+ * The pattern belongs to a src_w x src_h picture and is sampled on a
+ * width x height YUV420P grid. At the source size it is the benchmark
+ * input; at a destination size it is the ground truth the scalers are
+ * measured against, computed from the formula rather than by any of the
+ * scalers under test. Frequencies above the Nyquist limit of the grid are
+ * left out on each axis, as an ideal low-pass scaler would do. */
+static void fill_bench_image(uint8_t *data[4], int linesize[4], int width, int height, int src_w, int src_h)
+{
+    int x, y;
+    double k = M_PI / (2.0 * FFMAX(src_w, src_h));
+    double sx = (double)src_w / width, sy = (double)src_h / height;
+    
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            // pixel centre in source coordinates; the phase is k * r^2, its slope 2 * k * d per pixel
+            double dx = (x + 0.5) * sx - 0.5 - src_w / 2, dy = (y + 0.5) * sy - 0.5 - src_h / 2;
+            int pass = 2 * k * fabs(dx) * sx < M_PI && 2 * k * fabs(dy) * sy < M_PI;
+            data[0][y * linesize[0] + x] = (uint8_t)(128 + (pass ? 100 * cos(k * (dx * dx + dy * dy)) : 0));
+        }
+    }
+    for (y = 0; y < height / 2; y++) {
+        for (x = 0; x < width / 2; x++) {
+            double cx = (x + 0.5) * sx - 0.5, cy = (y + 0.5) * sy - 0.5;
+            data[1][y * linesize[1] + x] = (uint8_t)(128 + (8 * k * cx * sx < M_PI ? 60 * cos(4 * k * cx * cx) : 0));
+            data[2][y * linesize[2] + x] = (uint8_t)(128 + (8 * k * cy * sy < M_PI ? 60 * cos(4 * k * cy * cy) : 0));
+        }
+    }
+}
+
+/* Allocates a width x height picture in fmt holding the pattern of a
+ * src_w x src_h picture, converted from YUV420P without scaling. */
+static int alloc_bench_image(uint8_t *data[4], int linesize[4], int width, int height,
+                             enum AVPixelFormat fmt, int src_w, int src_h)
+{
+    uint8_t *yuv_data[4];
+    int yuv_linesize[4];
+    struct SwsContext *ctx;
+    
+    if (av_image_alloc(data, linesize, width, height, fmt, 16) < 0)
+        return AVERROR(ENOMEM);
+    if (fmt == AV_PIX_FMT_YUV420P) {
+        fill_bench_image(data, linesize, width, height, src_w, src_h);
+        return 0;
+    }
+    if (av_image_alloc(yuv_data, yuv_linesize, width, height, AV_PIX_FMT_YUV420P, 16) < 0) {
+        av_freep(&data[0]);
+        return AVERROR(ENOMEM);
+    }
+    fill_bench_image(yuv_data, yuv_linesize, width, height, src_w, src_h);
+    ctx = sws_getContext(width, height, AV_PIX_FMT_YUV420P, width, height, fmt,
+                         BENCH_CONVERT_FLAGS, NULL, NULL, NULL);
+    if (!ctx) {
+        av_freep(&yuv_data[0]);
+        av_freep(&data[0]);
+        return AVERROR(EINVAL);
+    }
+    sws_scale(ctx, (const uint8_t * const*)yuv_data, yuv_linesize, 0, height, data, linesize);
+    sws_freeContext(ctx);
+    av_freep(&yuv_data[0]);
+    return 0;
+}
+
+/* PSNR over every byte of every plane of two 8 bit pictures */
+static double picture_psnr(uint8_t *a[4], int a_linesize[4], uint8_t *b[4], int b_linesize[4],
+                           enum AVPixelFormat fmt, int width, int height)
 {
-    FILE *f = NULL;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+    int nb_planes = av_pix_fmt_count_planes(fmt);
+    double sse = 0, count = 0;
+    int p, x, y;
+    
+    for (p = 0; p < nb_planes; p++) {
+        int bytes = av_image_get_linesize(fmt, width, p);
+        int rows = (p == 1 || p == 2) ? -((-height) >> desc->log2_chroma_h) : height;
+        for (y = 0; y < rows; y++) {
+            const uint8_t *ra = a[p] + y * a_linesize[p];
+            const uint8_t *rb = b[p] + y * b_linesize[p];
+            for (x = 0; x < bytes; x++) {
+                int d = ra[x] - rb[x];
+                sse += d * d;
+            }
+        }
+        count += (double)bytes * rows;
+    }
+    if (sse == 0)
+        return INFINITY;
+    return 10 * log10(255.0 * 255.0 * count / sse);
+}
+
+/* Sweep algorithms, sizes, input and output formats; print one row per
+ * combination with throughput in output megapixels per second and PSNR
+ * against the pattern rendered directly at the destination size. */
+static int run_benchmark(int nb_frames)
+{
+    size_t s, sf, d, f, a;
     int i;
     
-    if (buf == NULL) {
-        fprintf(stderr, "buf == NULL\n");
-        return;
+    printf("%-14s %-10s %-8s %-10s %-8s %10s %8s\n", "algorithm", "source", "format", "dest", "format", "MP/s", "PSNR");
+    for (s = 0; s < ARRAY_ELEMS(bench_src_sizes); s++) {
+        for (sf = 0; sf < ARRAY_ELEMS(bench_src_fmts); sf++) {
+            enum AVPixelFormat src_pix_fmt = bench_src_fmts[sf];
+            uint8_t *src_data[4];
+            int src_linesize[4];
+            int src_w, src_h;
+            
+            av_parse_video_size(&src_w, &src_h, bench_src_sizes[s]);
+            if (alloc_bench_image(src_data, src_linesize, src_w, src_h, src_pix_fmt, src_w, src_h) < 0) {
+                fprintf(stderr, "Could not create the %s source image\n", av_get_pix_fmt_name(src_pix_fmt));
+                return 1;
+            }
+            
+            for (d = 0; d < ARRAY_ELEMS(bench_dst_sizes); d++) {
+                int dst_w, dst_h;
+                av_parse_video_size(&dst_w, &dst_h, bench_dst_sizes[d]);
+                if (dst_w > src_w)
+                    continue; // upscaling is not what we ship
+                
+                for (f = 0; f < ARRAY_ELEMS(bench_dst_fmts); f++) {
+                    enum AVPixelFormat dst_pix_fmt = bench_dst_fmts[f];
+                    uint8_t *ref_data[4], *dst_data[4];
+                    int ref_linesize[4], dst_linesize[4];
+                    
+                    if (alloc_bench_image(ref_data, ref_linesize, dst_w, dst_h, dst_pix_fmt, src_w, src_h) < 0) {
+                        fprintf(stderr, "Could not create the %s reference image\n", av_get_pix_fmt_name(dst_pix_fmt));
+                        return 1;
+                    }
+                    if (av_image_alloc(dst_data, dst_linesize, dst_w, dst_h, dst_pix_fmt, 16) < 0) {
+                        fprintf(stderr, "Could not allocate destination image\n");
+                        return 1;
+                    }
+                    
+                    for (a = 0; a < ARRAY_ELEMS(bench_algos); a++) {
+                        struct SwsContext *ctx = sws_getContext(src_w, src_h, src_pix_fmt,
+                                                                dst_w, dst_h, dst_pix_fmt,
+                                                                bench_algos[a].flags, NULL, NULL, NULL);
+                        int64_t start, elapsed;
+                        if (!ctx) {
+                            fprintf(stderr, "Could not create the %s scaler\n", bench_algos[a].name);
+                            continue;
+                        }
+                        // one untimed run to warm up caches
+                        sws_scale(ctx, (const uint8_t * const*)src_data, src_linesize, 0, src_h, dst_data, dst_linesize);
+                        start = av_gettime_relative();
+                        for (i = 0; i < nb_frames; i++)
+                            sws_scale(ctx, (const uint8_t * const*)src_data, src_linesize, 0, src_h, dst_data, dst_linesize);
+                        elapsed = FFMAX(av_gettime_relative() - start, 1);
+                        sws_freeContext(ctx);
+                        
+                        printf("%-14s %-10s %-8s %-10s %-8s %10.1f %8.2f\n",
+                               bench_algos[a].name, bench_src_sizes[s], av_get_pix_fmt_name(src_pix_fmt),
+                               bench_dst_sizes[d], av_get_pix_fmt_name(dst_pix_fmt),
+                               (double)dst_w * dst_h * nb_frames / elapsed,
+                               picture_psnr(dst_data, dst_linesize, ref_data, ref_linesize,
+                                            dst_pix_fmt, dst_w, dst_h));
+                    }
+                    av_freep(&ref_data[0]);
+                    av_freep(&dst_data[0]);
+                }
+            }
+            av_freep(&src_data[0]);
+        }
+    }
+    return 0;
+}
+
+/**************************************************************/
+/* YUV420P -> RGB24 fast path check */
+
+// largest per-byte difference accepted against swscale's own converter
+#define YUV2RGB_MAX_ERROR 3
+
+/* Compare the C, SSE2 and AVX2 versions of yuv2rgb.h with each other (must
+ * be identical, odd sizes included) and with sws_scale (bounded error). */
+static int run_yuv2rgb_verify(void)
+{
+    static const char *sizes[] = { "320x240", "1920x1080", "33x17", "1001x3" };
+    static const int cpu_flags[] = { 0, AV_CPU_FLAG_SSE2, AV_CPU_FLAG_AVX2 };
+    int failed = 0;
+    size_t s, f;
+    int cs, range, i;
+    
+    for (s = 0; s < ARRAY_ELEMS(sizes); s++) {
+        uint8_t *src_data[4], *ref_data[4], *out_data[4], *sws_data[4];
+        int src_linesize[4], ref_linesize[4], out_linesize[4], sws_linesize[4];
+        int w, h;
+        
+        av_parse_video_size(&w, &h, sizes[s]);
+        if (av_image_alloc(src_data, src_linesize, w, h, AV_PIX_FMT_YUV420P, 16) < 0 ||
+            av_image_alloc(ref_data, ref_linesize, w, h, AV_PIX_FMT_RGB24, 16) < 0 ||
+            av_image_alloc(out_data, out_linesize, w, h, AV_PIX_FMT_RGB24, 16) < 0 ||
+            av_image_alloc(sws_data, sws_linesize, w, h, AV_PIX_FMT_RGB24, 16) < 0) {
+            fprintf(stderr, "Could not allocate image\n");
+            return 1;
+        }
+        fill_yuv_image(src_data, src_linesize, w, h, 7);
+        
+        for (cs = 0; cs < 2; cs++) {
+            for (range = 0; range < 2; range++) {
+                Yuv2RgbMatrix m = yuv2rgb_matrix(cs, range);
+                int max_error = 0;
+                
+                yuv420p_to_rgb24(yuv2rgb_row_c, (const uint8_t * const*)src_data, src_linesize,
+                                 ref_data[0], ref_linesize[0], w, 0, h, &m);
+                for (f = 1; f < ARRAY_ELEMS(cpu_flags); f++) {
+                    if (!(av_get_cpu_flags() & cpu_flags[f]))
+                        continue;
+                    yuv420p_to_rgb24(yuv2rgb_get_row_func(cpu_flags[f]), (const uint8_t * const*)src_data,
+                                     src_linesize, out_data[0], out_linesize[0], w, 0, h, &m);
+                    for (i = 0; i < h; i++) {
+                        if (memcmp(ref_data[0] + i * ref_linesize[0], out_data[0] + i * out_linesize[0], w * 3)) {
+                            fprintf(stderr, "%s: SIMD variant %zu differs from C in row %d\n", sizes[s], f, i);
+                            failed = 1;
+                            break;
+                        }
+                    }
+                }
+                
+                // swscale's unscaled converter only handles even heights
+                if (!(h & 1)) {
+                    struct SwsContext *ctx = sws_getContext(w, h, AV_PIX_FMT_YUV420P, w, h, AV_PIX_FMT_RGB24,
+                                                            SWS_BILINEAR, NULL, NULL, NULL);
+                    int *inv_table, *table, src_range, dst_range, brightness, contrast, saturation;
+                    if (!ctx) {
+                        fprintf(stderr, "%s: could not create the reference SwsContext\n", sizes[s]);
+                        failed = 1;
+                        continue;
+                    }
+                    sws_getColorspaceDetails(ctx, &inv_table, &src_range, &table, &dst_range,
+                                             &brightness, &contrast, &saturation);
+                    sws_setColorspaceDetails(ctx, sws_getCoefficients(cs ? SWS_CS_ITU709 : SWS_CS_ITU601), range,
+                                             table, dst_range, brightness, contrast, saturation);
+                    sws_scale(ctx, (const uint8_t * const*)src_data, src_linesize, 0, h, sws_data, sws_linesize);
+                    sws_freeContext(ctx);
+                    for (i = 0; i < h; i++) {
+                        const uint8_t *a = ref_data[0] + i * ref_linesize[0];
+                        const uint8_t *b = sws_data[0] + i * sws_linesize[0];
+                        int x;
+                        for (x = 0; x < w * 3; x++)
+                            max_error = FFMAX(max_error, abs(a[x] - b[x]));
+                    }
+                }
+                printf("%-10s %s %-7s max difference to sws_scale: %d\n", sizes[s],
+                       cs ? "BT.709" : "BT.601", range ? "full" : "limited", max_error);
+                if (max_error > YUV2RGB_MAX_ERROR)
+                    failed = 1;
+            }
+        }
+        av_freep(&src_data[0]);
+        av_freep(&ref_data[0]);
+        av_freep(&out_data[0]);
+        av_freep(&sws_data[0]);
+    }
+    printf(failed ? "yuv2rgb verification FAILED\n" : "yuv2rgb verification passed\n");
+    return failed;
+}
+
+/**************************************************************/
+/* read -> scale -> write pipeline */
+
+// frames in flight between two neighbouring stages
+#define PIPELINE_DEPTH 4
+// a pyramid level is scaled from a larger output instead of the source
+// when that output is at most this many times bigger in each direction
+#define PYRAMID_MAX_STEP 2
+
+// one raw picture in a single contiguous buffer, the layout of a .yuv/.rgb file
+struct RawFrame {
+    uint8_t *data[4];
+    int linesize[4];
+};
+
+// one output size
+struct PyramidLevel {
+    int w, h;
+    int parent;                 // level this one is scaled from, -1 for the source
+    FILE *out_file;
+    SliceSwsContext *sws_ctx;
+};
+
+struct ScalePipeline {
+    FILE *in_file;              // NULL: generate nb_frames synthetic pictures instead
+    int nb_frames;
+    FILE *tee_file;             // optional copy of every source frame, for debugging
+    int src_w, src_h;
+    enum AVPixelFormat src_pix_fmt;
+    enum AVPixelFormat dst_pix_fmt;
+    int sws_flags;
+    std::vector<PyramidLevel> levels;   // largest first, see plan_pyramid()
+};
+
+// all outputs of one source frame
+struct OutputFrames {
+    std::vector<RawFrame> level;
+};
+
+static int alloc_raw_frame(RawFrame *frame, int w, int h, enum AVPixelFormat fmt)
+{
+    // align 1 keeps the planes back to back, so one fread/fwrite moves a frame
+    return av_image_alloc(frame->data, frame->linesize, w, h, fmt, 1);
+}
+
+static bool level_by_area_desc(const PyramidLevel &a, const PyramidLevel &b)
+{
+    return (int64_t)a.w * a.h > (int64_t)b.w * b.h;
+}
+
+/* Order the levels largest first and pick for each one the next larger
+ * output as its input when it is close enough in size, so smaller sizes
+ * are derived from already scaled pictures rather than the full source. */
+static void plan_pyramid(ScalePipeline *p)
+{
+    std::stable_sort(p->levels.begin(), p->levels.end(), level_by_area_desc);
+    for (size_t i = 0; i < p->levels.size(); i++) {
+        PyramidLevel *l = &p->levels[i];
+        l->parent = -1;
+        for (int j = (int)i - 1; j >= 0; j--) {
+            const PyramidLevel *up = &p->levels[j];
+            if (up->w < l->w || up->h < l->h)
+                continue;
+            // the nearest larger level; if that one is too big, all others are too
+            if (up->w <= PYRAMID_MAX_STEP * l->w && up->h <= PYRAMID_MAX_STEP * l->h)
+                l->parent = j;
+            break;
+        }
+    }
+}
+
+/* Reader, scaler and writer run on their own threads and hand frames over
+ * through bounded queues, so reading the next frame, scaling the current
+ * one and writing the previous one overlap. With several levels the
+ * scaler runs the independent levels of a frame in parallel. Returns the
+ * number of frames written or a negative error. */
+static int run_pipeline(ScalePipeline *p)
+{
+    int src_size = av_image_get_buffer_size(p->src_pix_fmt, p->src_w, p->src_h, 1);
+    size_t nb_levels = p->levels.size();
+    std::vector<RawFrame> src_frames(PIPELINE_DEPTH);
+    std::vector<OutputFrames> dst_frames(PIPELINE_DEPTH);
+    BlockingQueue<RawFrame *> src_free(PIPELINE_DEPTH), src_full(PIPELINE_DEPTH);
+    BlockingQueue<OutputFrames *> dst_free(PIPELINE_DEPTH), dst_full(PIPELINE_DEPTH);
+    ThreadPool *level_pool = NULL;
+    RawFrame *src = NULL;
+    OutputFrames *dst = NULL;
+    int nb_written = 0, read_error = 0, write_error = 0;
+    int ret = 0;
+    size_t i, l;
+    
+    for (l = 0; l < nb_levels; l++) {
+        PyramidLevel *lv = &p->levels[l];
+        int in_w = lv->parent < 0 ? p->src_w : p->levels[lv->parent].w;
+        int in_h = lv->parent < 0 ? p->src_h : p->levels[lv->parent].h;
+        enum AVPixelFormat in_fmt = lv->parent < 0 ? p->src_pix_fmt : p->dst_pix_fmt;
+        lv->sws_ctx = slice_sws_getContext(in_w, in_h, in_fmt, lv->w, lv->h, p->dst_pix_fmt, p->sws_flags, 0);
+        if (!lv->sws_ctx) {
+            fprintf(stderr,
+                    "Impossible to create scale context for the conversion "
+                    "fmt:%s s:%dx%d -> fmt:%s s:%dx%d\n",
+                    av_get_pix_fmt_name(in_fmt), in_w, in_h,
+                    av_get_pix_fmt_name(p->dst_pix_fmt), lv->w, lv->h);
+            ret = AVERROR(EINVAL);
+            goto end;
+        }
+    }
+    for (i = 0; i < PIPELINE_DEPTH; i++) {
+        if (alloc_raw_frame(&src_frames[i], p->src_w, p->src_h, p->src_pix_fmt) < 0) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        dst_frames[i].level.resize(nb_levels);
+        for (l = 0; l < nb_levels; l++) {
+            if (alloc_raw_frame(&dst_frames[i].level[l], p->levels[l].w, p->levels[l].h, p->dst_pix_fmt) < 0) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+        }
+        src_free.push(&src_frames[i]);
+        dst_free.push(&dst_frames[i]);
+    }
+    if (nb_levels > 1)
+        level_pool = new ThreadPool((int)FFMIN(nb_levels, (size_t)ThreadPool::defaultThreadCount()));
+    
+    {
+        std::thread reader([&]() {
+            RawFrame *f;
+            for (int n = 0; src_free.pop(f); n++) {
+                if (p->in_file) {
+                    size_t got = fread(f->data[0], 1, src_size, p->in_file);
+                    if (got != (size_t)src_size) {
+                        if (got || ferror(p->in_file)) {
+                            fprintf(stderr, "Truncated or unreadable source frame %d\n", n);
+                            read_error = 1;
+                        }
+                        break;
+                    }
+                } else {
+                    if (n >= p->nb_frames)
+                        break;
+                    // generate synthetic video
+                    fill_yuv_image(f->data, f->linesize, p->src_w, p->src_h, n);
+                }
+                if (p->tee_file)
+                    fwrite(f->data[0], 1, src_size, p->tee_file);
+                src_full.push(f);
+            }
+            src_full.close();
+        });
+        
+        std::thread writer([&]() {
+            OutputFrames *f;
+            while (dst_full.pop(f)) {
+                // keep draining after an error so the scaler never blocks
+                for (size_t k = 0; k < nb_levels && !write_error; k++) {
+                    int size = av_image_get_buffer_size(p->dst_pix_fmt, p->levels[k].w, p->levels[k].h, 1);
+                    if (fwrite(f->level[k].data[0], 1, size, p->levels[k].out_file) != (size_t)size) {
+                        fprintf(stderr, "Could not write frame %d\n", nb_written);
+                        write_error = 1;
+                    }
+                }
+                if (!write_error)
+                    nb_written++;
+                dst_free.push(f);
+            }
+        });
+        
+        // scale one level, then queue the levels that are derived from it
+        std::function<void (size_t)> scale_level = [&](size_t k) {
+            const PyramidLevel *lv = &p->levels[k];
+            const RawFrame *in = lv->parent < 0 ? src : &dst->level[lv->parent];
+            slice_sws_scale(lv->sws_ctx, (const uint8_t * const*)in->data, in->linesize,
+                            dst->level[k].data, dst->level[k].linesize);
+            for (size_t c = k + 1; c < nb_levels; c++) {
+                if (p->levels[c].parent == (int)k)
+                    level_pool->submit([&scale_level, c]() { scale_level(c); });
+            }
+        };
+        
+        // the scaler stage runs here
+        while (src_full.pop(src)) {
+            dst_free.pop(dst);
+            if (!level_pool) {
+                scale_level(0);
+            } else {
+                for (l = 0; l < nb_levels; l++) {
+                    if (p->levels[l].parent < 0)
+                        level_pool->submit([&scale_level, l]() { scale_level(l); });
+                }
+                level_pool->wait();
+            }
+            src_free.push(src);
+            dst_full.push(dst);
+        }
+        dst_full.close();
+        src_free.close();
+        
+        reader.join();
+        writer.join();
     }
     
-    f=fopen(YUV_FILE_NAME, "ab+");
-    for (i = 0; i < ysize; ++i) {
-        fwrite(buf + i*wrap, 1, xsize, f);
+    if (read_error || write_error)
+        ret = AVERROR(EIO);
+    else
+        ret = nb_written;
+end:
+    delete level_pool;
+    for (i = 0; i < PIPELINE_DEPTH; i++) {
+        av_freep(&src_frames[i].data[0]);
+        for (l = 0; l < dst_frames[i].level.size(); l++)
+            av_freep(&dst_frames[i].level[l].data[0]);
     }
-    fflush(f);
-    fclose(f);
-    f = NULL;
+    for (l = 0; l < nb_levels; l++)
+        slice_sws_freeContext(p->levels[l].sws_ctx);
+    return ret;
+}
+
+/* "out.rgb" + 640x360 -> "out_640x360.rgb" */
+static std::string level_filename(const char *filename, int w, int h)
+{
+    std::string name(filename);
+    size_t dot = name.rfind('.');
+    size_t slash = name.rfind('/');
+    char suffix[32];
+    
+    snprintf(suffix, sizeof(suffix), "_%dx%d", w, h);
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return name + suffix;
+    return name.substr(0, dot) + suffix + name.substr(dot);
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [options] output_file output_size[,output_size...]\n"
+            "       %s -bench [frames]\n"
+            "       %s -verify\n"
+            "API example program to show how to scale an image with libswscale.\n"
+            "This program generates a series of pictures, rescales them to the given "
+            "output_size and saves them to an output file named output_file\n."
+            "With several comma separated sizes every size is written to its own file\n"
+            "(output_WxH.ext) and smaller sizes are scaled from larger outputs.\n"
+            "Options:\n"
+            "  -i input_file   scale a raw video file instead of synthetic pictures\n"
+            "  -s WxH          size of the input frames (default 320x240)\n"
+            "  -src_fmt fmt    pixel format of the input (default yuv420p)\n"
+            "  -dst_fmt fmt    pixel format of the output (default rgb24)\n"
+            "  -tee file       also write every source frame to file, for debugging\n"
+            "With -bench it instead measures speed and PSNR of the scaler algorithms,\n"
+            "-verify checks the YUV420P to RGB24 fast path against sws_scale.\n"
+            "\n", program, program, program);
+    exit(1);
 }
 
 int main( int argc, char* argv[] )
 {
-    uint8_t *src_data[4], *dst_data[4];
-    int src_linesize[4], dst_linesize[4];
-    int src_w = 320, src_h = 240, dst_w, dst_h;
-    enum AVPixelFormat src_pix_fmt = AV_PIX_FMT_YUV420P;
-    enum AVPixelFormat dst_pix_fmt = AV_PIX_FMT_RGB24;
-    const char *dst_size = nullptr;
+    ScalePipeline p;
+    const char *src_size = "320x240";
+    const char *dst_sizes = nullptr;
+    const char *src_filename = nullptr;
     const char *dst_filename = nullptr;
-    FILE *dst_file = nullptr;
-    int dst_buffer;
-    struct SwsContext *sws_ctx;
+    const char *tee_filename = nullptr;
+    size_t l;
     int i, ret;
+    int64_t start;
     
+    if (argc >= 2 && !strcmp(argv[1], "-bench"))
+        return run_benchmark(argc >= 3 ? atoi(argv[2]) : 20);
+    if (argc >= 2 && !strcmp(argv[1], "-verify"))
+        return run_yuv2rgb_verify();
     
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s output_file output_size\n"
-                "API example program to show how to scale an image with libswscale.\n"
-                "This program generates a series of pictures, rescales them to the given "
-                "output_size and saves them to an output file named output_file\n."
-                "\n", argv[0]);
+    p.in_file     = nullptr;
+    p.tee_file    = nullptr;
+    p.nb_frames   = 100;
+    p.src_pix_fmt = AV_PIX_FMT_YUV420P;
+    p.dst_pix_fmt = AV_PIX_FMT_RGB24;
+    p.sws_flags   = SWS_BILINEAR;
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            src_filename = argv[++i];
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            src_size = argv[++i];
+        } else if (!strcmp(argv[i], "-src_fmt") && i + 1 < argc) {
+            p.src_pix_fmt = av_get_pix_fmt(argv[++i]);
+        } else if (!strcmp(argv[i], "-dst_fmt") && i + 1 < argc) {
+            p.dst_pix_fmt = av_get_pix_fmt(argv[++i]);
+        } else if (!strcmp(argv[i], "-tee") && i + 1 < argc) {
+            tee_filename = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+        } else if (!dst_filename) {
+            dst_filename = argv[i];
+        } else if (!dst_sizes) {
+            dst_sizes = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (!dst_filename || !dst_sizes)
+        usage(argv[0]);
+    if (p.src_pix_fmt == AV_PIX_FMT_NONE || p.dst_pix_fmt == AV_PIX_FMT_NONE) {
+        fprintf(stderr, "Unknown pixel format\n");
         exit(1);
     }
-    dst_filename = argv[1];
-    dst_size     = argv[2];
-    
-    if (av_parse_video_size(&dst_w, &dst_h, dst_size) < 0) {
-        fprintf(stderr, "Invalid size '%s', must be in the form WxH or a valid size abbreviation\n",dst_size);
+    if (!src_filename && p.src_pix_fmt != AV_PIX_FMT_YUV420P) {
+        fprintf(stderr, "Synthetic pictures are always yuv420p\n");
         exit(1);
     }
     
-    dst_file = fopen(dst_filename, "wb");
-    if (!dst_file) {
-        fprintf(stderr, "Could not open destination file %s\n", dst_filename);
+    if (av_parse_video_size(&p.src_w, &p.src_h, src_size) < 0) {
+        fprintf(stderr, "Invalid size '%s', must be in the form WxH or a valid size abbreviation\n",src_size);
         exit(1);
     }
-    
-    // create scaling context
-    sws_ctx = sws_getContext(src_w, src_h, src_pix_fmt, dst_w, dst_h, dst_pix_fmt, SWS_BILINEAR, NULL, NULL, NULL);
-    
-    if (!sws_ctx) {
-        fprintf(stderr,
-                "Impossible to create scale context for the conversion "
-                "fmt:%s s:%dx%d -> fmt:%s s:%dx%d\n",
-                av_get_pix_fmt_name(src_pix_fmt), src_w, src_h,
-                av_get_pix_fmt_name(dst_pix_fmt), dst_w, dst_h);
-        ret = AVERROR(EINVAL);
-        //goto end;
-    }
-    // allocate source and destination image buffers
-    if ((ret = av_image_alloc(src_data, src_linesize, src_w, src_h, src_pix_fmt, 16)) < 0) {
-        fprintf(stderr, "Could not allocate source image\n");
-       // goto end;
+    {
+        std::string sizes(dst_sizes);
+        size_t pos = 0;
+        while (pos <= sizes.size()) {
+            size_t comma = sizes.find(',', pos);
+            std::string size = sizes.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+            PyramidLevel lv = { 0 };
+            if (av_parse_video_size(&lv.w, &lv.h, size.c_str()) < 0) {
+                fprintf(stderr, "Invalid size '%s', must be in the form WxH or a valid size abbreviation\n", size.c_str());
+                exit(1);
+            }
+            p.levels.push_back(lv);
+            if (comma == std::string::npos)
+                break;
+            pos = comma + 1;
+        }
     }
+    plan_pyramid(&p);
     
-    if ((ret = av_image_alloc(dst_data, dst_linesize, dst_w, dst_h, dst_pix_fmt, 1)) < 0) {
-        fprintf(stderr, "Could not allocate source image\n");
-       // goto end;
+    if (src_filename) {
+        p.in_file = fopen(src_filename, "rb");
+        if (!p.in_file) {
+            fprintf(stderr, "Could not open source file %s\n", src_filename);
+            exit(1);
+        }
     }
-    
-    dst_buffer = ret;
-    FILE* yuvFile = fopen("yuvout.yuv", "wb");
-    for (i = 0; i < 100; ++i) {
-        // generate synthetix video
-        fill_yuv_image(src_data, src_linesize, src_w, src_h, i);
-//        saveYUV420P(src_data[0], src_linesize[0], src_w, src_h);
-//        saveYUV420P(src_data[1], src_linesize[1], src_w/2, src_h/2);
-//        saveYUV420P(src_data[2], src_linesize[2], src_w/2, src_h/2);
-        fwrite(src_data[0], 1, src_w*src_h, yuvFile);
-        fwrite(src_data[1], 1, src_w*src_h/4, yuvFile);
-        fwrite(src_data[2], 1, src_w*src_h/4, yuvFile);
-        // convert to destination format
-        sws_scale(sws_ctx, (const uint8_t * const*)src_data, src_linesize, 0, src_h, dst_data, dst_linesize);
-        
-        // write scaled image to file
-        fwrite(dst_data[0], 1, dst_buffer, dst_file);
+    for (l = 0; l < p.levels.size(); l++) {
+        PyramidLevel *lv = &p.levels[l];
+        std::string name = p.levels.size() == 1 ? std::string(dst_filename)
+                                                : level_filename(dst_filename, lv->w, lv->h);
+        lv->out_file = fopen(name.c_str(), "wb");
+        if (!lv->out_file) {
+            fprintf(stderr, "Could not open destination file %s\n", name.c_str());
+            exit(1);
+        }
+        if (lv->parent < 0)
+            fprintf(stderr, "%s: %dx%d from the source\n", name.c_str(), lv->w, lv->h);
+        else
+            fprintf(stderr, "%s: %dx%d from %dx%d\n", name.c_str(), lv->w, lv->h,
+                    p.levels[lv->parent].w, p.levels[lv->parent].h);
+    }
+    if (tee_filename) {
+        p.tee_file = fopen(tee_filename, "wb");
+        if (!p.tee_file) {
+            fprintf(stderr, "Could not open debug file %s\n", tee_filename);
+            exit(1);
+        }
     }
-    fclose(yuvFile);
-    fprintf(stderr, "Scaling succeeded. Play the output file with the command:\n"
-            "ffplay -f rawvideo -pix_fmt %s -video_size %dx%d %s\n",
-            av_get_pix_fmt_name(dst_pix_fmt), dst_w, dst_h, dst_filename);
     
+    start = av_gettime_relative();
+    ret = run_pipeline(&p);
+    if (ret >= 0) {
+        double seconds = FFMAX(av_gettime_relative() - start, 1) / 1000000.0;
+        fprintf(stderr, "Scaled %d frames in %.2fs (%.1f fps)\n", ret, seconds, ret / seconds);
+        for (l = 0; l < p.levels.size(); l++)
+            fprintf(stderr, "Play output %dx%d with the command:\n"
+                    "ffplay -f rawvideo -pix_fmt %s -video_size %dx%d %s\n",
+                    p.levels[l].w, p.levels[l].h, av_get_pix_fmt_name(p.dst_pix_fmt),
+                    p.levels[l].w, p.levels[l].h,
+                    p.levels.size() == 1 ? dst_filename
+                                         : level_filename(dst_filename, p.levels[l].w, p.levels[l].h).c_str());
+    }
     
-end:
-    fclose(dst_file);
-    av_freep(&src_data[0]);
-    av_freep(&dst_data[0]);
-    sws_freeContext(sws_ctx);
+    if (p.in_file)
+        fclose(p.in_file);
+    if (p.tee_file)
+        fclose(p.tee_file);
+    for (l = 0; l < p.levels.size(); l++)
+        fclose(p.levels[l].out_file);
     return ret < 0;
-    
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -16,9 +16,21 @@
  * MKV, FLV, AVI...) to video and audio bitstream.
  * In this example, it demux a MPEG2TS file to H.264 bitstream
  * and AAC bitstream.
+ *
+ * Every selected stream (all video and audio tracks, subtitles, data)
+ * goes to its own output file, written by its own thread, so one slow
+ * output does not hold up the read loop or the other outputs.
+ *
+ * With a fourth argument the read loop also builds a keyframe index of
+ * the input and saves it as a sidecar file (see keyframe_index.h).
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <thread>
 
 #define __STDC_CONSTANT_MACROS
 
@@ -27,6 +39,7 @@
 extern "C"
 {
 #include "libavformat/avformat.h"
+#include "libavutil/time.h"
 };
 #else
 //Linux...
@@ -35,228 +48,439 @@ extern "C"
 {
 #endif
 #include "libavformat/avformat.h"
+#include "libavutil/time.h"
 #ifdef __cplusplus
 };
 #endif
 #endif
+#include "../../common/blocking_queue.h"
+#include "../../common/keyframe_index.h"
 
 /*
- FIX: H.264 in some container format (FLV, MP4, MKV etc.) need
- "h264_mp4toannexb" bitstream filter (BSF)
- *Add SPS,PPS in front of IDR frame
+ FIX: H.264 and HEVC in some container format (FLV, MP4, MKV etc.) need
+ the "h264_mp4toannexb" / "hevc_mp4toannexb" bitstream filter (BSF)
+ *Add SPS,PPS (VPS) in front of IDR frames
  *Add start code ("0,0,0,1") in front of NALU
  H.264 in some container (MPEG2TS) don't need this BSF.
+ It is enabled automatically for streams that need it.
  */
-//'1': Use H.264 Bitstream Filter
-#define USE_H264BSF 0
+// av_bsf_send_packet()/av_bsf_receive_packet() appeared in libavcodec 57.37.100 (FFmpeg 3.1)
+#define HAVE_BSF_API (LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 37, 100))
+
+// packets an output may fall behind the read loop before reading waits for it
+#define DEMUX_QUEUE_SIZE 1024
+
+// one output file holding one input stream
+struct DemuxOutput {
+    int in_index;
+    std::string filename;
+    AVFormatContext *ofmt_ctx;
+    BlockingQueue<AVPacket *> *queue;
+    std::thread writer;
+    // mp4 -> Annex B conversion, NULL when the stream is written as is
+#if HAVE_BSF_API
+    AVBSFContext *bsf;
+    AVPacket filtered;      // reused for every packet the filter returns
+#else
+    AVBitStreamFilterContext *bsf;
+#endif
+    long packets;
+    int64_t bytes;
+    int error;
+};
+
+/* File extension for a stream, raw elementary stream formats where
+ * libavformat has one; *format is set when the extension alone does not
+ * select the muxer. */
+static const char *stream_extension(const AVCodecContext *codec, const char **format)
+{
+    *format = NULL;
+    switch (codec->codec_id) {
+        case AV_CODEC_ID_H264:       return "h264";
+        case AV_CODEC_ID_HEVC:       return "hevc";
+        case AV_CODEC_ID_MPEG1VIDEO: return "m1v";
+        case AV_CODEC_ID_MPEG2VIDEO: return "m2v";
+        case AV_CODEC_ID_MPEG4:      return "m4v";
+        case AV_CODEC_ID_AAC:        return "aac";
+        case AV_CODEC_ID_MP2:        return "mp2";
+        case AV_CODEC_ID_MP3:        return "mp3";
+        case AV_CODEC_ID_AC3:        return "ac3";
+        case AV_CODEC_ID_EAC3:       return "eac3";
+        case AV_CODEC_ID_DTS:        return "dts";
+        case AV_CODEC_ID_SUBRIP:     return "srt";
+        case AV_CODEC_ID_ASS:        return "ass";
+        case AV_CODEC_ID_WEBVTT:     return "vtt";
+        default:
+            break;
+    }
+    if (codec->codec_type == AVMEDIA_TYPE_DATA) {
+        // raw payload, e.g. SCTE-35 or ID3 tracks
+        *format = "data";
+        return "bin";
+    }
+    return "mkv";
+}
+
+/* types is a list of v(ideo), a(udio), s(ubtitle) and d(ata) */
+static int stream_selected(const AVStream *st, const char *types)
+{
+    switch (st->codec->codec_type) {
+        case AVMEDIA_TYPE_VIDEO:    return strchr(types, 'v') != NULL;
+        case AVMEDIA_TYPE_AUDIO:    return strchr(types, 'a') != NULL;
+        case AVMEDIA_TYPE_SUBTITLE: return strchr(types, 's') != NULL;
+        case AVMEDIA_TYPE_DATA:     return strchr(types, 'd') != NULL;
+        default:                    return 0;
+    }
+}
+
+/* The Annex B filter for a stream stored in mp4 form: H.264/HEVC from
+ * MP4, Matroska or FLV, whose extradata is an avcC/hvcC record (these
+ * start with version 1, Annex B extradata starts with a start code). */
+static const char *annexb_filter(const AVFormatContext *ifmt_ctx, const AVCodecContext *codec)
+{
+    const char *name = ifmt_ctx->iformat->name;
+
+    if (!strstr(name, "mp4") && !strstr(name, "matroska") && strcmp(name, "flv") != 0)
+        return NULL;
+    if (!codec->extradata || codec->extradata_size < 1 || codec->extradata[0] != 1)
+        return NULL;
+    if (codec->codec_id == AV_CODEC_ID_H264)
+        return "h264_mp4toannexb";
+    if (codec->codec_id == AV_CODEC_ID_HEVC)
+        return "hevc_mp4toannexb";
+    return NULL;
+}
+
+static int open_annexb_filter(DemuxOutput *out, AVStream *in_stream, const char *name)
+{
+#if HAVE_BSF_API
+    const AVBitStreamFilter *filter = av_bsf_get_by_name(name);
+    int ret;
+
+    if (!filter)
+        return AVERROR_BSF_NOT_FOUND;
+    if ((ret = av_bsf_alloc(filter, &out->bsf)) < 0)
+        return ret;
+    if ((ret = avcodec_parameters_from_context(out->bsf->par_in, in_stream->codec)) < 0)
+        return ret;
+    out->bsf->time_base_in = in_stream->time_base;
+    if ((ret = av_bsf_init(out->bsf)) < 0)
+        return ret;
+    av_init_packet(&out->filtered);
+    out->filtered.data = NULL;
+    out->filtered.size = 0;
+    return 0;
+#else
+    out->bsf = av_bitstream_filter_init(name);
+    return out->bsf ? 0 : AVERROR_BSF_NOT_FOUND;
+#endif
+}
+
+static void close_annexb_filter(DemuxOutput *out)
+{
+#if HAVE_BSF_API
+    av_bsf_free(&out->bsf);
+    av_free_packet(&out->filtered);
+#else
+    if (out->bsf)
+        av_bitstream_filter_close(out->bsf);
+    out->bsf = NULL;
+#endif
+}
+
+static int open_output(DemuxOutput *out, AVFormatContext *ifmt_ctx, int index, const char *prefix)
+{
+    AVStream *in_stream = ifmt_ctx->streams[index];
+    AVStream *out_stream;
+    const char *format;
+    const char *ext = stream_extension(in_stream->codec, &format);
+    const char *filter = annexb_filter(ifmt_ctx, in_stream->codec);
+    char filename[1024];
+    int ret;
+
+    snprintf(filename, sizeof(filename), "%s.%d.%s", prefix, index, ext);
+    out->in_index = index;
+    out->filename = filename;
+
+    avformat_alloc_output_context2(&out->ofmt_ctx, NULL, format, filename);
+    if (!out->ofmt_ctx) {
+        printf("Could not create output context for %s\n", filename);
+        return AVERROR_UNKNOWN;
+    }
+    out_stream = avformat_new_stream(out->ofmt_ctx, in_stream->codec->codec);
+    if (!out_stream) {
+        printf("Failed allocating output stream for %s\n", filename);
+        return AVERROR_UNKNOWN;
+    }
+    //Copy the settings of AVCodecContext
+    if (avcodec_copy_context(out_stream->codec, in_stream->codec) < 0) {
+        printf("Failed to copy context from input to output stream codec context\n");
+        return AVERROR_UNKNOWN;
+    }
+    out_stream->codec->codec_tag = 0;
+    if (out->ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+        out_stream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+    // before the file is created, so a stream without its filter leaves nothing on disk
+    if (filter && (ret = open_annexb_filter(out, in_stream, filter)) < 0) {
+        printf("Could not open the %s bitstream filter\n", filter);
+        return ret;
+    }
+
+    //open output file
+    if (!(out->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&out->ofmt_ctx->pb, filename, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            printf("Could not open output file %s\n", filename);
+            return ret;
+        }
+    }
+    //write file header
+    ret = avformat_write_header(out->ofmt_ctx, NULL);
+    if (ret < 0) {
+        printf("Error occurred when writing the header of %s\n", filename);
+        return ret;
+    }
+    return 0;
+}
+
+// rescales and writes one packet; the muxer takes its reference
+static void write_packet(DemuxOutput *out, AVStream *in_stream, AVPacket *pkt)
+{
+    AVStream *out_stream = out->ofmt_ctx->streams[0];
+
+    out->packets++;
+    out->bytes += pkt->size;
+
+    //Convert PTS/DTS
+    pkt->pts = av_rescale_q_rnd(pkt->pts, in_stream->time_base, out_stream->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX));
+    pkt->dts = av_rescale_q_rnd(pkt->dts, in_stream->time_base, out_stream->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX));
+    pkt->duration = av_rescale_q(pkt->duration, in_stream->time_base, out_stream->time_base);
+    pkt->pos = -1;
+    //必须置零
+    pkt->stream_index = 0;
+
+    //Write
+    if (av_interleaved_write_frame(out->ofmt_ctx, pkt) < 0) {
+        printf("Error muxing packet into %s\n", out->filename.c_str());
+        // keep draining so the read loop never waits for this output
+        out->error = 1;
+    }
+}
+
+/* Runs pkt through the Annex B filter and writes what comes out; NULL
+ * drains the filter at the end of the stream. */
+static void filter_packet(DemuxOutput *out, AVStream *in_stream, AVPacket *pkt)
+{
+#if HAVE_BSF_API
+    // the filter takes over pkt's buffer, nothing is copied on the way in
+    int ret = av_bsf_send_packet(out->bsf, pkt);
+    while (ret >= 0) {
+        ret = av_bsf_receive_packet(out->bsf, &out->filtered);
+        if (ret < 0)
+            break;
+        write_packet(out, in_stream, &out->filtered);
+    }
+    if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+        printf("Bitstream filter error on %s\n", out->filename.c_str());
+        out->error = 1;
+    }
+#else
+    AVPacket fpkt;
+    int ret;
+
+    if (!pkt)
+        return;
+    fpkt = *pkt;
+    ret = av_bitstream_filter_filter(out->bsf, in_stream->codec, NULL, &fpkt.data, &fpkt.size,
+                                     pkt->data, pkt->size, pkt->flags & AV_PKT_FLAG_KEY);
+    if (ret < 0) {
+        printf("Bitstream filter error on %s\n", out->filename.c_str());
+        out->error = 1;
+        return;
+    }
+    if (ret > 0) {
+        // a new buffer: hand its ownership to the packet so it is freed with it
+        fpkt.buf = av_buffer_create(fpkt.data, fpkt.size, av_buffer_default_free, NULL, 0);
+        if (!fpkt.buf) {
+            av_free(fpkt.data);
+            out->error = 1;
+            return;
+        }
+        av_free_packet(pkt);
+        *pkt = fpkt;
+    } else {
+        // the payload was only trimmed in place
+        pkt->data = fpkt.data;
+        pkt->size = fpkt.size;
+    }
+    write_packet(out, in_stream, pkt);
+#endif
+}
+
+// writer thread: filter, rescale and write everything the read loop queues for this output
+static void write_loop(DemuxOutput *out, AVFormatContext *ifmt_ctx)
+{
+    AVStream *in_stream = ifmt_ctx->streams[out->in_index];
+    AVPacket *pkt;
+
+    while (out->queue->pop(pkt)) {
+        if (!out->error) {
+            if (out->bsf)
+                filter_packet(out, in_stream, pkt);
+            else
+                write_packet(out, in_stream, pkt);
+        }
+        av_free_packet(pkt);
+        av_free(pkt);
+    }
+    if (out->bsf && !out->error)
+        filter_packet(out, in_stream, NULL);
+}
 
 int main(int argc, char* argv[])
 {
-    AVOutputFormat *ofmt_a = NULL, *ofmt_v = NULL;
-    //Input AVFormatContext and Output AVFormatContext
-    AVFormatContext *ifmt_ctx = NULL, *ofmt_ctx_a = NULL, *ofmt_ctx_v = NULL;
+    //Input AVFormatContext
+    AVFormatContext *ifmt_ctx = NULL;
+    std::vector<DemuxOutput *> outputs;
+    std::vector<DemuxOutput *> by_stream;
+    KeyframeIndex index;
     AVPacket pkt;
-    int ret, i;
-    int videoindex = -1, audioindex = -1;
-    int frame_index = 0;
-    
+    int ret;
+    unsigned i;
+    int64_t start, read_bytes = 0;
+    double seconds;
+
     const char *in_filename = "cuc_ieschool.ts";
     //const char *in_filename = "cuc_ieshool.mkv";
-    const char *out_filename_v = "cuc_ieschool.h264";
-    //const *out_filename_a = "cuc_ieschool.mp3";
-    const char *out_filename_a = "cuc_ieschool.aac";
-    
+    const char *out_prefix = "cuc_ieschool";
+    const char *types = "vasd";
+    const char *index_filename = NULL;
+
+    if (argc > 1)
+        in_filename = argv[1];
+    if (argc > 2)
+        out_prefix = argv[2];
+    if (argc > 3)
+        types = argv[3];
+    if (argc > 4)
+        index_filename = argv[4];
+
     av_register_all();
-    
+
     //read input file headers
     if ((ret = avformat_open_input(&ifmt_ctx, in_filename, 0, 0)) < 0) {
-        
+
         printf( "Could not open input file.");
         goto end;
     }
 
-    
-    //find stream information
-    avformat_find_stream_info(ifmt_ctx, NULL);
-    
-    //Output
-    //video
-    avformat_alloc_output_context2(&ofmt_ctx_v, NULL, NULL, out_filename_v);
-    ofmt_v = ofmt_ctx_v->oformat;
-    //audio
-    avformat_alloc_output_context2(&ofmt_ctx_a, NULL, NULL, out_filename_a);
-    ofmt_a = ofmt_ctx_a->oformat;
-    
-    for (i = 0; i < ifmt_ctx->nb_streams; ++i) {
-        AVFormatContext *ofmt_ctx;
-        AVStream *in_stream = ifmt_ctx->streams[i];
-        AVStream *out_stream = NULL;
-        
-        if (ifmt_ctx->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
-
-            
-            printf("%s\n",avcodec_get_name(currentStream->codec->codec_id));
-            videoindex = i;
-            out_stream = avformat_new_stream(ofmt_ctx_v, in_stream->codec->codec);
-            ofmt_ctx = ofmt_ctx_v;
-        }
-        else if(ifmt_ctx->streams[i]->codec->codec_type == AVMEDIA_TYPE_AUDIO){
-            printf("%s\n",avcodec_get_name(currentStream->codec->codec_id));
-            audioindex = i;
-            out_stream = avformat_new_stream(ofmt_ctx_a, in_stream->codec->codec);
-            ofmt_ctx = ofmt_ctx_a;
-        }
-        else
-            break;
-        
-        //Copy the settings of AVCodecContext
-        
-        if (avcodec_copy_context(out_stream->codec, in_stream->codec) < 0) {
-            printf( "Failed to copy context from input to output stream codec context\n");
-        }
-        out_stream->codec->codec_tag = 0;
-        
-        if (ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
-            out_stream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
 
+    //find stream information
+    if ((ret = avformat_find_stream_info(ifmt_ctx, NULL)) < 0) {
+        printf( "Failed to retrieve input stream information");
+        goto end;
     }
-    
-    //Dump Format------------------
-    
-    printf("\n==============Input Video=============\n");
-    
+
+    printf("\n==============Input=============\n");
     av_dump_format(ifmt_ctx, 0, in_filename, 0);
-    printf("\n==============Output Video============\n");
-    av_dump_format(ofmt_ctx_v, 0, out_filename_v, 1);
-    printf("\n==============Output Audio============\n");
-    av_dump_format(ofmt_ctx_a, 0, out_filename_a, 1);
-    printf("\n======================================\n");
+    printf("\n================================\n");
+    if (index_filename)
+        index.reset(ifmt_ctx);
 
-    //open output file
-    if (!(ofmt_v->flags & AVFMT_NOFILE)) {
-        avio_open(&ofmt_ctx_v->pb, out_filename_v, AVIO_FLAG_WRITE);
+    //Output: one per selected stream
+    by_stream.resize(ifmt_ctx->nb_streams, NULL);
+    for (i = 0; i < ifmt_ctx->nb_streams; ++i) {
+        AVStream *in_stream = ifmt_ctx->streams[i];
+        DemuxOutput *out;
+
+        if (!stream_selected(in_stream, types))
+            continue;
+        out = new DemuxOutput();
+        if (open_output(out, ifmt_ctx, i, out_prefix) < 0) {
+            // the other streams are still worth extracting
+            printf("Skipping stream %u (%s)\n", i, avcodec_get_name(in_stream->codec->codec_id));
+            close_annexb_filter(out);
+            if (out->ofmt_ctx && out->ofmt_ctx->pb && !(out->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+                avio_closep(&out->ofmt_ctx->pb);
+                unlink(out->filename.c_str());
+            }
+            avformat_free_context(out->ofmt_ctx);
+            delete out;
+            continue;
+        }
+        printf("Stream %u (%s) -> %s%s\n", i, avcodec_get_name(in_stream->codec->codec_id), out->filename.c_str(),
+               out->bsf ? " (Annex B)" : "");
+        out->queue = new BlockingQueue<AVPacket *>(DEMUX_QUEUE_SIZE);
+        out->writer = std::thread(write_loop, out, ifmt_ctx);
+        outputs.push_back(out);
+        by_stream[i] = out;
     }
-    
-    if (!(ofmt_a->flags & AVFMT_NOFILE)) {
-        avio_open(&ofmt_ctx_a->pb, out_filename_a, AVIO_FLAG_WRITE);
+    // an empty type list with an index file only builds the index
+    if (outputs.empty() && !index_filename) {
+        printf("No stream selected.\n");
+        goto end;
     }
-    
-    //write file header
-    avformat_write_header(ofmt_ctx_v, NULL);
-    avformat_write_header(ofmt_ctx_a, NULL);
-    
-#if USE_H264BSF
-    
-    AVBitStreamFilterContext* h264bsfc =  av_bitstream_filter_init("h264_mp4toannexb");
-#endif
-    
 
+    start = av_gettime_relative();
     while (1) {
-        AVFormatContext *ofmt_ctx;
-        AVStream *in_stream, *out_stream;
+        AVPacket *queued;
         //get an packet
-        if(av_read_frame(ifmt_ctx, &pkt) < 0)
+        if ((ret = av_read_frame(ifmt_ctx, &pkt)) < 0)
             break;
-        
-        in_stream = ifmt_ctx->streams[pkt.stream_index];
-        
-        if(pkt.stream_index == videoindex){
-            out_stream = ofmt_ctx_v->streams[0];
-            ofmt_ctx = ofmt_ctx_v;
-            printf("Write Video Packet. size:%d\tpts:%lld\n",pkt.size,pkt.pts);
-#if USE_H264BSF
-            
-            av_bitstream_filter_filter(h264bsfc, in_stream->codec, NULL, &pkt.data, &pkt.size, pkt.data, pkt.size, 0);
-#endif
+        if (index_filename)
+            index.addPacket(&pkt);
+
+        if (pkt.stream_index >= (int)by_stream.size() || !by_stream[pkt.stream_index]) {
+            av_free_packet(&pkt);
+            continue;
         }
-        else if(pkt.stream_index == audioindex){
-            out_stream = ofmt_ctx_a->streams[0];
-            ofmt_ctx = ofmt_ctx_a;
-            printf("Write Audio Packet. size:%d\tpts:%lld\n",pkt.size,pkt.pts);
+        read_bytes += pkt.size;
+
+        // the packet moves to the writer; make sure it owns its data first
+        if (av_dup_packet(&pkt) < 0 || !(queued = (AVPacket *)av_malloc(sizeof(*queued)))) {
+            av_free_packet(&pkt);
+            ret = AVERROR(ENOMEM);
+            break;
         }
+        *queued = pkt;
+        by_stream[pkt.stream_index]->queue->push(queued);
+    }
+
+    for (i = 0; i < outputs.size(); i++)
+        outputs[i]->queue->close();
+    for (i = 0; i < outputs.size(); i++) {
+        DemuxOutput *out = outputs[i];
+        out->writer.join();
+        //Write file trailer
+        av_write_trailer(out->ofmt_ctx);
+        printf("%s: %ld packets, %lld bytes%s\n", out->filename.c_str(), out->packets,
+               (long long)out->bytes, out->error ? ", write errors" : "");
+    }
+    seconds = (av_gettime_relative() - start) / 1000000.0;
+    if (index_filename) {
+        if (index.save(index_filename))
+            printf("Keyframe index written to %s\n", index_filename);
         else
-            continue;
-        
-        //Convert PTS/DTS
-        pkt.pts = av_rescale_q_rnd(pkt.pts, in_stream->time_base, out_stream->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX));
-        
-        pkt.dts = av_rescale_q_rnd(pkt.dts, in_stream->time_base, out_stream->time_base, (AVRounding)(AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX));
-        pkt.duration = av_rescale_q(pkt.duration, in_stream->time_base, out_stream->time_base);
-        pkt.pos = -1;
-        //必须置零
-        pkt.stream_index = 0;
-        
-        //Write
-        av_interleaved_write_frame(ofmt_ctx, &pkt);
-        
-        av_free_packet(&pkt);
+            printf("Could not write keyframe index %s\n", index_filename);
     }
-#if USE_H264BSF
-    av_bitstream_filter_close(h264bsfc);
-#endif
-    
-    
-    //Write file trailer
-    
-    av_write_trailer(ofmt_ctx_a);
-    
-    av_write_trailer(ofmt_ctx_v);
-
-    
+    printf("Demuxed %.1f MB into %d outputs in %.2fs\n", read_bytes / 1e6, (int)outputs.size(), seconds);
+
 end:
     avformat_close_input(&ifmt_ctx);
     /* close output */
-    if (ofmt_ctx_a && !(ofmt_a->flags & AVFMT_NOFILE))
-        avio_close(ofmt_ctx_a->pb);
-    
-    if (ofmt_ctx_v && !(ofmt_v->flags & AVFMT_NOFILE))
-        avio_close(ofmt_ctx_v->pb);
-    
-    avformat_free_context(ofmt_ctx_a);
-    avformat_free_context(ofmt_ctx_v);
-    
-    
+    for (i = 0; i < outputs.size(); i++) {
+        DemuxOutput *out = outputs[i];
+        close_annexb_filter(out);
+        if (!(out->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
+            avio_close(out->ofmt_ctx->pb);
+        avformat_free_context(out->ofmt_ctx);
+        delete out->queue;
+        delete out;
+    }
+
     if (ret < 0 && ret != AVERROR_EOF) {
         printf( "Error occurred.\n");
         return -1;
     }
     return 0;
-
-    
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
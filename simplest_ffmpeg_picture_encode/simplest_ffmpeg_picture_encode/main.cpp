@@ -4,9 +4,27 @@
  *
  * 本程序实现了YUV420P像素数据编码为JPEG图片。是最简单的FFmpeg编码方面的教程。
  * 通过学习本例子可以了解FFmpeg的编码流程。
+ *
+ * This software encodes a YUV420P frame into a JPEG picture.
+ *
+ * With -batch it encodes every frame of one large YUV file, and with
+ * -list the first frame of every file in a list, on a set of worker
+ * threads in one process. Each worker owns its MJPEG encoder, reads its
+ * frames and writes its own JPEG files, so the workers share nothing but
+ * the counter that hands out the next image.
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 #define __STDC_CONSTANT_MACROS
 
@@ -15,6 +33,9 @@ extern "C"
 {
 #include "libavcodec/avcodec.h"
 #include "libavformat/avformat.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/parseutils.h"
+#include "libavutil/time.h"
 };
 #else
 
@@ -24,11 +45,308 @@ extern "C"
 #endif
 #include "libavcodec/avcodec.h"
 #include "libavformat/avformat.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/parseutils.h"
+#include "libavutil/time.h"
 #ifdef __cplusplus
 };
 #endif
 #endif
 
+#include "../../common/thread_pool.h"
+#include "../../common/lock_manager.h"
+
+struct EncodeJob {
+    std::string input;
+    std::string output;
+};
+
+/* The images of a batch: either frame i of one YUV file (yuv_fd) or the
+ * first frame of jobs[i]. Workers take the next image with next++. */
+struct EncodeBatch {
+    int yuv_fd;
+    const char *output_pattern;     // "out_%05d.jpg", for a YUV file
+    std::vector<EncodeJob> jobs;
+    int nb_images;
+    int width, height;
+    int qscale;                     // 2 (best) .. 31, 0 for the encoder default
+    std::atomic<int> next;
+};
+
+struct EncodeWorker {
+    std::thread thread;
+    int images, failed;
+    int64_t bytes;
+};
+
+static AVCodecContext *open_jpeg_encoder(int width, int height, int qscale)
+{
+    AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    AVCodecContext *enc;
+
+    if (!codec)
+        return NULL;
+    enc = avcodec_alloc_context3(codec);
+    if (!enc)
+        return NULL;
+    enc->pix_fmt = AV_PIX_FMT_YUVJ420P;
+    enc->width = width;
+    enc->height = height;
+    enc->time_base.num = 1;
+    enc->time_base.den = 25;
+    // the batch is already parallel across images
+    enc->thread_count = 1;
+    if (qscale > 0) {
+        enc->flags |= AV_CODEC_FLAG_QSCALE;
+        enc->global_quality = qscale * FF_QP2LAMBDA;
+    }
+    if (avcodec_open2(enc, codec, NULL) < 0) {
+        avcodec_free_context(&enc);
+        return NULL;
+    }
+    return enc;
+}
+
+// reads image i of the batch into buf, returns false if it is not there
+static bool read_image(EncodeBatch *batch, int i, uint8_t *buf, int size)
+{
+    FILE *f;
+    bool ok;
+
+    if (batch->yuv_fd >= 0)
+        return pread(batch->yuv_fd, buf, size, (off_t)i * size) == size;
+    f = fopen(batch->jobs[i].input.c_str(), "rb");
+    if (!f)
+        return false;
+    ok = fread(buf, 1, size, f) == (size_t)size;
+    fclose(f);
+    return ok;
+}
+
+static bool write_image(const char *filename, const AVPacket *pkt)
+{
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int done = 0;
+
+    if (fd < 0)
+        return false;
+    // a JPEG file is the bare MJPEG packet, no muxer needed;
+    // one write() normally, loop only on a short write
+    while (done < pkt->size) {
+        ssize_t n = write(fd, pkt->data + done, pkt->size - done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    return close(fd) == 0 && done == pkt->size;
+}
+
+static void encode_worker(EncodeBatch *batch, EncodeWorker *worker)
+{
+    AVCodecContext *enc = open_jpeg_encoder(batch->width, batch->height, batch->qscale);
+    AVFrame *frame = av_frame_alloc();
+    int size = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, batch->width, batch->height, 1);
+    uint8_t *buf = (uint8_t *)av_malloc(size);
+    char filename[1024];
+    AVPacket pkt;
+    int i, got_picture;
+
+    if (!enc || !frame || !buf) {
+        printf("Could not open the JPEG encoder.\n");
+        // leave the images to the other workers
+        goto end;
+    }
+    frame->format = enc->pix_fmt;
+    frame->width = enc->width;
+    frame->height = enc->height;
+    frame->quality = enc->global_quality;
+    av_image_fill_arrays(frame->data, frame->linesize, buf, AV_PIX_FMT_YUV420P, enc->width, enc->height, 1);
+
+    while ((i = batch->next++) < batch->nb_images) {
+        const char *out;
+        if (batch->yuv_fd >= 0) {
+            av_get_frame_filename(filename, sizeof(filename), batch->output_pattern, i);
+            out = filename;
+        } else {
+            out = batch->jobs[i].output.c_str();
+        }
+        if (!read_image(batch, i, buf, size)) {
+            printf("FAILED %s: could not read the frame\n", out);
+            worker->failed++;
+            continue;
+        }
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+        frame->pts = i;
+        got_picture = 0;
+        if (avcodec_encode_video2(enc, &pkt, frame, &got_picture) < 0 || !got_picture) {
+            printf("FAILED %s: could not encode\n", out);
+            worker->failed++;
+        } else if (!write_image(out, &pkt)) {
+            printf("FAILED %s: could not write\n", out);
+            worker->failed++;
+        } else {
+            worker->images++;
+            worker->bytes += pkt.size;
+        }
+        av_free_packet(&pkt);
+    }
+
+end:
+    av_free(buf);
+    av_frame_free(&frame);
+    avcodec_free_context(&enc);
+}
+
+// "input.yuv<TAB>output.jpg" per line, blank lines and '#' comments skipped
+static int read_list(const char *filename, std::vector<EncodeJob>& jobs)
+{
+    FILE *f = fopen(filename, "r");
+    char line[4096];
+
+    if (!f) {
+        printf("Could not open list file '%s'\n", filename);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char *tab;
+        EncodeJob job;
+        line[strcspn(line, "\r\n")] = 0;
+        if (!line[0] || line[0] == '#')
+            continue;
+        tab = strchr(line, '\t');
+        if (!tab) {
+            printf("Skipping list line without a tab: %s\n", line);
+            continue;
+        }
+        *tab = 0;
+        job.input = line;
+        job.output = tab + 1;
+        jobs.push_back(job);
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Encodes the whole batch on nb_workers threads and reports the rate.
+ * Returns the number of images that failed. */
+static int run_batch(EncodeBatch *batch, int nb_workers)
+{
+    std::vector<EncodeWorker> workers(nb_workers);
+    int64_t start, time, bytes = 0;
+    int images = 0, failed = 0;
+    int i;
+
+    if (av_lockmgr_register(mutex_lock_manager) < 0) {
+        printf("Could not register the lock manager\n");
+        return -1;
+    }
+    printf("Encoding %d images of %dx%d on %d workers\n", batch->nb_images, batch->width, batch->height, nb_workers);
+    batch->next = 0;
+    start = av_gettime_relative();
+    for (i = 0; i < nb_workers; i++) {
+        workers[i].images = workers[i].failed = 0;
+        workers[i].bytes = 0;
+        workers[i].thread = std::thread(encode_worker, batch, &workers[i]);
+    }
+    for (i = 0; i < nb_workers; i++) {
+        workers[i].thread.join();
+        images += workers[i].images;
+        failed += workers[i].failed;
+        bytes  += workers[i].bytes;
+    }
+    time = av_gettime_relative() - start;
+    av_lockmgr_register(NULL);
+
+    // a worker without an encoder left its share to the others; none at all leaves them undone
+    failed += batch->nb_images - images - failed;
+    printf("\n%d of %d images encoded, %d failed, %.3fs\n", images, batch->nb_images, failed, time / 1000000.0);
+    if (time > 0)
+        printf("%.1f images/s, %.2f MB/s of JPEG\n", images * 1000000.0 / time, bytes / (double)time);
+    return failed;
+}
+
+static int batch_main(int argc, char *argv[])
+{
+    EncodeBatch batch;
+    int nb_workers = ThreadPool::defaultThreadCount();
+    int frame_size, i, ret;
+    int first_option = !strcmp(argv[1], "-batch") ? 5 : 4;
+    struct stat st;
+
+    if (argc < first_option) {
+        printf("usage: %s -batch frames.yuv WxH output_%%05d.jpg [-workers n] [-qscale q]\n"
+               "       %s -list list_file WxH [-workers n] [-qscale q]\n"
+               "-batch encodes every YUV420P frame of frames.yuv, frame i into the file\n"
+               "output_pattern names with i. -list encodes the first frame of every\n"
+               "\"input.yuv<TAB>output.jpg\" line of list_file. -workers defaults to one per CPU,\n"
+               "-qscale 2..31 sets a fixed JPEG quality (lower is better), 0 keeps the default.\n",
+               argv[0], argv[0]);
+        return 1;
+    }
+    batch.yuv_fd = -1;
+    batch.output_pattern = NULL;
+    batch.nb_images = 0;
+    batch.qscale = 0;
+    if (av_parse_video_size(&batch.width, &batch.height, argv[3]) < 0) {
+        printf("Invalid frame size '%s'\n", argv[3]);
+        return 1;
+    }
+    for (i = first_option; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-workers")) {
+            nb_workers = atoi(argv[i+1]);
+            if (nb_workers <= 0) {
+                printf("Invalid worker count '%s'\n", argv[i+1]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "-qscale")) {
+            char *end;
+            batch.qscale = (int)strtol(argv[i+1], &end, 10);
+            if (end == argv[i+1] || *end || (batch.qscale != 0 && (batch.qscale < 2 || batch.qscale > 31))) {
+                printf("Invalid JPEG quality '%s', use 2..31 or 0 for the default\n", argv[i+1]);
+                return 1;
+            }
+        } else {
+            printf("Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+
+    av_register_all();
+
+    frame_size = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, batch.width, batch.height, 1);
+    if (!strcmp(argv[1], "-batch")) {
+        char name[1024];
+        batch.output_pattern = argv[4];
+        if (av_get_frame_filename(name, sizeof(name), batch.output_pattern, 0) < 0) {
+            printf("The output pattern '%s' needs a %%d\n", batch.output_pattern);
+            return 1;
+        }
+        batch.yuv_fd = open(argv[2], O_RDONLY);
+        if (batch.yuv_fd < 0 || fstat(batch.yuv_fd, &st) < 0) {
+            printf("Could not open input file %s.\n", argv[2]);
+            return -1;
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        // the workers take the frames in order, only a few apart
+        posix_fadvise(batch.yuv_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        batch.nb_images = (int)(st.st_size / frame_size);
+    } else {
+        if (read_list(argv[2], batch.jobs) < 0)
+            return -1;
+        batch.nb_images = (int)batch.jobs.size();
+    }
+    if (nb_workers > batch.nb_images && batch.nb_images > 0)
+        nb_workers = batch.nb_images;
+
+    ret = run_batch(&batch, nb_workers);
+    if (batch.yuv_fd >= 0)
+        close(batch.yuv_fd);
+    return ret == 0 ? 0 : -1;
+}
+
 int main(int argc, char *argv[])
 {
     AVFormatContext* pFormatCtx = nullptr;
@@ -46,6 +364,9 @@ int main(int argc, char *argv[])
     
     int ret = 0;
     
+    if (argc > 1 && (!strcmp(argv[1], "-batch") || !strcmp(argv[1], "-list")))
+        return batch_main(argc, argv);
+    
     // YUV source
     FILE *in_file = nullptr;
     int in_w = 480, in_h = 272;
@@ -1,15 +1,1199 @@
-//
-//  main.cpp
-//  simplest_ffmpeg_remuxer
-//
-//  Created by meitu on 15/10/16.
-//  Copyright © 2015年 meitu. All rights reserved.
-//
-
-#include <iostream>
-
-int main(int argc, const char * argv[]) {
-    // insert code here...
-    std::cout << "Hello, World!\n";
+/**
+ * 最简单的基于FFmpeg的封装格式转换器
+ * Simplest FFmpeg Remuxer
+ *
+ * 雷霄骅 Lei Xiaohua
+ * leixiaohua1020@126.com
+ * 中国传媒大学/数字电视技术
+ * Communication University of China / Digital TV Technology
+ * http://blog.csdn.net/leixiaohua1020
+ *
+ * 本程序实现了视频封装格式之间的转换。需要注意的是本程序并不进行
+ * 视音频的编码和解码工作。而是直接将视音频压缩码流从一种封装格式
+ * 文件中获取出来然后打包成另外一种封装格式的文件。
+ *
+ * This software converts a media file from one container format
+ * to another container format without encoding/decoding video files.
+ * Packets are moved from the input to the output by reference, the
+ * payload is never copied, and both files go through large AVIO
+ * buffers so the copy is bound by the disk, not the CPU.
+ *
+ * With -ss/-to it cuts a time range: it seeks to the keyframe before the
+ * start, copies up to the end, stops reading there and starts the output
+ * timestamps at zero. With -smart on the cut is frame accurate instead:
+ * only the partial GOPs at the two cut points are decoded and re-encoded,
+ * the whole GOPs between them are still copied.
+ *
+ * With -batch it works through a manifest of input/output pairs on a
+ * pool of worker threads, all in one process.
+ *
+ * With -concat it joins a list of inputs into one output with continuous
+ * timestamps, copying every stream that matches the first input and
+ * re-encoding only the ones that do not. Video is only re-encoded into
+ * outputs that carry the codec configuration in band, such as MPEG-TS;
+ * -check_concat exercises both cases on synthetic clips.
+ *
+ * The copy itself lives in remux.cpp. remux_memory() and
+ * remux_callbacks(), declared in remux.h, do it between buffers or caller
+ * supplied read/write functions, never touching the disk; -memory on runs
+ * a file through remux_memory().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#define __STDC_CONSTANT_MACROS
+
+#ifdef _WIN32
+//Windows
+extern "C"
+{
+#include "libavformat/avformat.h"
+#include "libavutil/time.h"
+#include "libavutil/parseutils.h"
+#include "libavutil/opt.h"
+#include "libavutil/audio_fifo.h"
+#include "libswscale/swscale.h"
+#include "libswresample/swresample.h"
+};
+#else
+//Linux...
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "libavformat/avformat.h"
+#include "libavutil/time.h"
+#include "libavutil/parseutils.h"
+#include "libavutil/opt.h"
+#include "libavutil/audio_fifo.h"
+#include "libswscale/swscale.h"
+#include "libswresample/swresample.h"
+#ifdef __cplusplus
+};
+#endif
+#endif
+#include "remux.h"
+#include "../../common/thread_pool.h"
+#include "../../common/lock_manager.h"
+
+static void print_stats(const char *label, const RemuxStats *stats)
+{
+    double seconds = stats->time / 1000000.0;
+    printf("%s: %.1f MB in, %.1f MB out, %ld packets in %.2fs, %.1f MB/s\n", label,
+           stats->bytes_in / 1e6, stats->bytes_out / 1e6, stats->packets, seconds,
+           seconds > 0 ? stats->bytes_in / 1e6 / seconds : 0.0);
+}
+
+/* Batch mode */
+
+struct BatchJob {
+    std::string input, output;
+    int ret;
+    RemuxStats stats;
+};
+
+// caps the number of files open at once across all workers
+struct OpenFileLimit {
+    std::mutex mutex;
+    std::condition_variable released;
+    int available;
+};
+
+static void open_files_acquire(OpenFileLimit *limit, int n)
+{
+    std::unique_lock<std::mutex> lock(limit->mutex);
+    limit->released.wait(lock, [limit, n]() { return limit->available >= n; });
+    limit->available -= n;
+}
+
+static void open_files_release(OpenFileLimit *limit, int n)
+{
+    {
+        std::lock_guard<std::mutex> lock(limit->mutex);
+        limit->available += n;
+    }
+    limit->released.notify_all();
+}
+
+/* One "input<TAB>output" pair per line; without a tab the two names are
+ * split at the first blank. Empty lines and lines starting with # are
+ * skipped. */
+static int read_manifest(const char *filename, std::vector<BatchJob>& jobs)
+{
+    FILE *f = fopen(filename, "r");
+    char line[4096];
+    int lineno = 0;
+
+    if (!f) {
+        printf("Could not open manifest '%s'\n", filename);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char *sep, *out;
+        BatchJob job;
+
+        lineno++;
+        line[strcspn(line, "\r\n")] = 0;
+        if (!line[0] || line[0] == '#')
+            continue;
+        sep = strchr(line, '\t');
+        if (!sep)
+            sep = strpbrk(line, " \t");
+        if (!sep) {
+            printf("%s:%d: expected an input and an output file\n", filename, lineno);
+            continue;
+        }
+        *sep = 0;
+        out = sep + 1;
+        while (*out == ' ' || *out == '\t')
+            out++;
+        if (!*out) {
+            printf("%s:%d: expected an input and an output file\n", filename, lineno);
+            continue;
+        }
+        job.input = line;
+        job.output = out;
+        job.ret = 0;
+        memset(&job.stats, 0, sizeof(job.stats));
+        jobs.push_back(job);
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Remuxes every job of the manifest. A job that fails is reported and
+ * the others carry on; returns the number of failed jobs. */
+static int run_batch(const char *manifest, const RemuxOptions *opt, int nb_workers, int max_open)
+{
+    std::vector<BatchJob> jobs;
+    OpenFileLimit limit;
+    RemuxStats total;
+    int64_t start;
+    int failed = 0;
+    size_t i;
+
+    if (read_manifest(manifest, jobs) < 0)
+        return -1;
+    if (jobs.empty()) {
+        printf("Manifest '%s' has no jobs\n", manifest);
+        return 0;
+    }
+    // avformat_find_stream_info() opens decoders on several threads
+    if (av_lockmgr_register(mutex_lock_manager) < 0) {
+        printf("Could not register the lock manager\n");
+        return -1;
+    }
+    // every job holds its input and its output open
+    limit.available = max_open < 2 ? 2 : max_open;
+
+    start = av_gettime_relative();
+    {
+        ThreadPool pool(nb_workers);
+        printf("Remuxing %d files on %d workers, at most %d files open\n",
+               (int)jobs.size(), pool.size(), limit.available);
+        for (i = 0; i < jobs.size(); i++) {
+            BatchJob *job = &jobs[i];
+            pool.submit([job, opt, &limit]() {
+                open_files_acquire(&limit, 2);
+                job->ret = remux(job->input.c_str(), job->output.c_str(), opt, &job->stats);
+                open_files_release(&limit, 2);
+                if (job->ret < 0)
+                    printf("FAILED %s -> %s\n", job->input.c_str(), job->output.c_str());
+                else
+                    print_stats(job->output.c_str(), &job->stats);
+            });
+        }
+        pool.wait();
+    }
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < jobs.size(); i++) {
+        if (jobs[i].ret < 0) {
+            failed++;
+            continue;
+        }
+        total.bytes_in  += jobs[i].stats.bytes_in;
+        total.bytes_out += jobs[i].stats.bytes_out;
+        total.packets   += jobs[i].stats.packets;
+    }
+    total.time = av_gettime_relative() - start;
+    printf("\n%d of %d files remuxed, %d failed\n", (int)jobs.size() - failed, (int)jobs.size(), failed);
+    print_stats("Total", &total);
+    for (i = 0; i < jobs.size(); i++) {
+        if (jobs[i].ret < 0)
+            printf("  failed: %s\n", jobs[i].input.c_str());
+    }
+    av_lockmgr_register(NULL);
+    return failed;
+}
+
+/* Concat mode */
+
+struct ConcatInput {
+    std::string filename;
+    AvioSource *source;
+    AVFormatContext *ic;
+    int ret;
+};
+
+// opens and probes one input; runs on the prefetch thread
+static void concat_open_input(ConcatInput *in, int avio_buffer)
+{
+    in->ic = NULL;
+    in->source = AvioSource::openFile(in->filename.c_str(), avio_buffer);
+    if (!in->source) {
+        in->ret = AVERROR(EIO);
+        return;
+    }
+    in->ic = avformat_alloc_context();
+    if (!in->ic) {
+        in->ret = AVERROR(ENOMEM);
+        return;
+    }
+    in->ic->pb = in->source->context();
+    if ((in->ret = avformat_open_input(&in->ic, in->filename.c_str(), NULL, NULL)) < 0)
+        return;
+    in->ret = avformat_find_stream_info(in->ic, NULL);
+}
+
+static void concat_close_input(ConcatInput *in)
+{
+    avformat_close_input(&in->ic);
+    delete in->source;
+    in->source = NULL;
+}
+
+// whether st can be copied into a stream set up from ref
+static int concat_copyable(const AVCodecContext *ref, const AVCodecContext *c)
+{
+    if (ref->codec_type != c->codec_type || ref->codec_id != c->codec_id)
+        return 0;
+    if (c->codec_type == AVMEDIA_TYPE_VIDEO &&
+        (ref->width != c->width || ref->height != c->height || ref->pix_fmt != c->pix_fmt))
+        return 0;
+    if (c->codec_type == AVMEDIA_TYPE_AUDIO &&
+        (ref->sample_rate != c->sample_rate || ref->channels != c->channels ||
+         (ref->channel_layout && c->channel_layout && ref->channel_layout != c->channel_layout)))
+        return 0;
+    // the output header carries the first input's codec configuration
+    if (ref->extradata_size && c->extradata_size &&
+        (ref->extradata_size != c->extradata_size || memcmp(ref->extradata, c->extradata, c->extradata_size)))
+        return 0;
+    return 1;
+}
+
+/* Re-encodes one input stream that does not match its output stream into
+ * the output stream's parameters. */
+struct ConcatEncoder {
+    AVCodecContext *dec, *enc;
+    struct SwsContext *sws;
+    struct SwrContext *swr;
+    AVAudioFifo *fifo;
+    AVFrame *frame;             // decoded
+    AVFrame *out;               // video: scaled for the encoder
+    int64_t next_pts;           // encoder time base; audio: the next sample
+    int64_t last_pts;           // video: last frame sent, to drop duplicates
+};
+
+struct ConcatOutput {
+    AVFormatContext *ofmt_ctx;
+    std::vector<int64_t> last_dts;          // per output stream, output time base
+    std::vector<int64_t> default_duration;  // for packets without one
+    int64_t segment_end;                    // AV_TIME_BASE, end of what was written for this input
+    long copied, encoded;
+};
+
+// writes pkt to output stream index, keeping dts increasing and tracking where the input ends
+static int concat_write(ConcatOutput *out, int index, AVPacket *pkt)
+{
+    AVStream *st = out->ofmt_ctx->streams[index];
+    int64_t duration = pkt->duration ? pkt->duration : out->default_duration[index];
+
+    if (pkt->dts != AV_NOPTS_VALUE) {
+        if (out->last_dts[index] != AV_NOPTS_VALUE && pkt->dts <= out->last_dts[index])
+            pkt->dts = out->last_dts[index] + 1;
+        if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts)
+            pkt->pts = pkt->dts;
+        out->last_dts[index] = pkt->dts;
+    }
+    if (pkt->pts != AV_NOPTS_VALUE) {
+        int64_t end = av_rescale_q(pkt->pts + duration, st->time_base, AV_TIME_BASE_Q);
+        if (end > out->segment_end)
+            out->segment_end = end;
+    }
+    pkt->stream_index = index;
+    pkt->pos = -1;
+    return av_interleaved_write_frame(out->ofmt_ctx, pkt);
+}
+
+/* Whether a video stream that does not match can be re-encoded into the
+ * output. The encoder runs without a global header, so its parameter sets
+ * are in band (Annex B for H.264/HEVC). Containers with a global header
+ * (mp4, mkv, flv) already hold the first input's avcC/hvcC and would store
+ * those packets as they are, unreadable for any decoder. */
+static int concat_can_reencode_video(const AVFormatContext *ofmt_ctx)
+{
+    return !(ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER);
+}
+
+static void concat_free_encoder(ConcatEncoder *ce)
+{
+    if (!ce)
+        return;
+    avcodec_free_context(&ce->dec);
+    avcodec_free_context(&ce->enc);
+    sws_freeContext(ce->sws);
+    swr_free(&ce->swr);
+    if (ce->fifo)
+        av_audio_fifo_free(ce->fifo);
+    av_frame_free(&ce->frame);
+    av_frame_free(&ce->out);
+    delete ce;
+}
+
+static ConcatEncoder *concat_open_encoder(AVStream *in_stream, AVStream *out_stream, int global_header)
+{
+    const AVCodecContext *ref = out_stream->codec;
+    AVCodec *decoder = avcodec_find_decoder(in_stream->codec->codec_id);
+    AVCodec *encoder = avcodec_find_encoder(ref->codec_id);
+    ConcatEncoder *ce = new ConcatEncoder();
+    AVCodecContext *c;
+
+    ce->next_pts = ce->last_pts = AV_NOPTS_VALUE;
+    ce->frame = av_frame_alloc();
+    ce->dec = decoder ? avcodec_alloc_context3(decoder) : NULL;
+    if (!encoder || !ce->frame || !ce->dec || avcodec_copy_context(ce->dec, in_stream->codec) < 0 ||
+        avcodec_open2(ce->dec, decoder, NULL) < 0)
+        goto fail;
+    ce->dec->refcounted_frames = 1;
+
+    c = ce->enc = avcodec_alloc_context3(encoder);
+    if (!c)
+        goto fail;
+    c->bit_rate = ref->bit_rate;
+    if (ref->codec_type == AVMEDIA_TYPE_VIDEO) {
+        AVRational rate = out_stream->avg_frame_rate.num ? out_stream->avg_frame_rate : in_stream->avg_frame_rate;
+        c->width               = ref->width;
+        c->height              = ref->height;
+        c->pix_fmt             = ref->pix_fmt;
+        c->sample_aspect_ratio = ref->sample_aspect_ratio;
+        c->time_base           = rate.num ? av_inv_q(rate) : (AVRational){1, 25};
+        // no global header: the parameter sets go in band, see concat_can_reencode_video()
+    } else {
+        c->sample_rate    = ref->sample_rate;
+        c->channels       = ref->channels;
+        c->channel_layout = ref->channel_layout ? ref->channel_layout : av_get_default_channel_layout(ref->channels);
+        c->sample_fmt     = ref->sample_fmt;
+        if (encoder->sample_fmts) {
+            const enum AVSampleFormat *f = encoder->sample_fmts;
+            while (*f != AV_SAMPLE_FMT_NONE && *f != ref->sample_fmt)
+                f++;
+            c->sample_fmt = *f != AV_SAMPLE_FMT_NONE ? *f : encoder->sample_fmts[0];
+        }
+        c->time_base = (AVRational){1, c->sample_rate};
+        // same configuration, same global header as the copied inputs (e.g. AAC)
+        if (global_header)
+            c->flags |= CODEC_FLAG_GLOBAL_HEADER;
+    }
+    if (avcodec_open2(c, encoder, NULL) < 0)
+        goto fail;
+
+    if (ref->codec_type == AVMEDIA_TYPE_VIDEO) {
+        ce->out = av_frame_alloc();
+        if (!ce->out)
+            goto fail;
+        ce->out->format = c->pix_fmt;
+        ce->out->width  = c->width;
+        ce->out->height = c->height;
+        if (av_frame_get_buffer(ce->out, 32) < 0)
+            goto fail;
+    } else {
+        const AVCodecContext *d = ce->dec;
+        ce->swr = swr_alloc();
+        if (!ce->swr)
+            goto fail;
+        av_opt_set_int       (ce->swr, "in_channel_layout",  d->channel_layout ? d->channel_layout : av_get_default_channel_layout(d->channels), 0);
+        av_opt_set_int       (ce->swr, "in_sample_rate",     d->sample_rate,    0);
+        av_opt_set_sample_fmt(ce->swr, "in_sample_fmt",      d->sample_fmt,     0);
+        av_opt_set_int       (ce->swr, "out_channel_layout", c->channel_layout, 0);
+        av_opt_set_int       (ce->swr, "out_sample_rate",    c->sample_rate,    0);
+        av_opt_set_sample_fmt(ce->swr, "out_sample_fmt",     c->sample_fmt,     0);
+        ce->fifo = av_audio_fifo_alloc(c->sample_fmt, c->channels, 1);
+        if (swr_init(ce->swr) < 0 || !ce->fifo)
+            goto fail;
+    }
+    return ce;
+fail:
+    printf("Could not set up re-encoding from %s to %s\n",
+           avcodec_get_name(in_stream->codec->codec_id), avcodec_get_name(ref->codec_id));
+    concat_free_encoder(ce);
+    return NULL;
+}
+
+// encodes frame (NULL drains the encoder) into output stream index
+static int concat_encode(ConcatOutput *out, int index, ConcatEncoder *ce, AVFrame *frame)
+{
+    AVStream *st = out->ofmt_ctx->streams[index];
+    AVPacket pkt;
+    int got, ret;
+
+    do {
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+        if (ce->enc->codec_type == AVMEDIA_TYPE_VIDEO)
+            ret = avcodec_encode_video2(ce->enc, &pkt, frame, &got);
+        else
+            ret = avcodec_encode_audio2(ce->enc, &pkt, frame, &got);
+        if (ret < 0)
+            return ret;
+        if (!got)
+            break;
+        av_packet_rescale_ts(&pkt, ce->enc->time_base, st->time_base);
+        out->encoded++;
+        if ((ret = concat_write(out, index, &pkt)) < 0)
+            return ret;
+    } while (!frame);
+    return 0;
+}
+
+// feeds whole encoder frames from the FIFO, the rest as well when flushing
+static int concat_drain_fifo(ConcatOutput *out, int index, ConcatEncoder *ce, int flush)
+{
+    int frame_size = ce->enc->frame_size > 0 ? ce->enc->frame_size : 1024;
+    int ret;
+
+    while (av_audio_fifo_size(ce->fifo) >= frame_size || (flush && av_audio_fifo_size(ce->fifo) > 0)) {
+        AVFrame *f = av_frame_alloc();
+        if (!f)
+            return AVERROR(ENOMEM);
+        f->nb_samples     = FFMIN(frame_size, av_audio_fifo_size(ce->fifo));
+        f->format         = ce->enc->sample_fmt;
+        f->channel_layout = ce->enc->channel_layout;
+        f->sample_rate    = ce->enc->sample_rate;
+        if ((ret = av_frame_get_buffer(f, 0)) < 0 ||
+            (ret = av_audio_fifo_read(ce->fifo, (void **)f->data, f->nb_samples)) < 0) {
+            av_frame_free(&f);
+            return ret;
+        }
+        f->pts = ce->next_pts;
+        ce->next_pts += f->nb_samples;
+        ret = concat_encode(out, index, ce, f);
+        av_frame_free(&f);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+/* Decodes pkt (NULL drains everything) and re-encodes it. delta moves the
+ * input's timestamps onto the output timeline, in the input time base. */
+static int concat_transcode(ConcatOutput *out, int index, ConcatEncoder *ce, AVStream *in_stream,
+                            AVPacket *pkt, int64_t delta)
+{
+    AVPacket dpkt;
+    int got, ret = 0;
+
+    if (pkt) {
+        dpkt = *pkt;
+    } else {
+        av_init_packet(&dpkt);
+        dpkt.data = NULL;
+        dpkt.size = 0;
+    }
+    while (1) {
+        int64_t ts;
+        if (ce->dec->codec_type == AVMEDIA_TYPE_VIDEO)
+            ret = avcodec_decode_video2(ce->dec, ce->frame, &got, &dpkt);
+        else
+            ret = avcodec_decode_audio4(ce->dec, ce->frame, &got, &dpkt);
+        if (ret < 0)
+            return pkt ? 0 : ret;      // a broken packet only costs its own frame
+        if (pkt) {
+            dpkt.data += ret;
+            dpkt.size -= ret;
+        }
+        if (!got) {
+            if (!pkt || dpkt.size <= 0 || ret == 0)
+                break;
+            continue;
+        }
+        ts = av_frame_get_best_effort_timestamp(ce->frame);
+        if (ts != AV_NOPTS_VALUE)
+            ts += delta;
+
+        if (ce->dec->codec_type == AVMEDIA_TYPE_VIDEO) {
+            int64_t pts = ts != AV_NOPTS_VALUE ? av_rescale_q(ts, in_stream->time_base, ce->enc->time_base)
+                                               : (ce->last_pts != AV_NOPTS_VALUE ? ce->last_pts + 1 : 0);
+            if (ce->last_pts == AV_NOPTS_VALUE || pts > ce->last_pts) {
+                if (!ce->sws)
+                    ce->sws = sws_getContext(ce->frame->width, ce->frame->height, (enum AVPixelFormat)ce->frame->format,
+                                             ce->enc->width, ce->enc->height, ce->enc->pix_fmt, SWS_BICUBIC, NULL, NULL, NULL);
+                if (!ce->sws || (ret = av_frame_make_writable(ce->out)) < 0) {
+                    av_frame_unref(ce->frame);
+                    return ce->sws ? ret : AVERROR(EINVAL);
+                }
+                sws_scale(ce->sws, (const uint8_t * const *)ce->frame->data, ce->frame->linesize, 0, ce->frame->height,
+                          ce->out->data, ce->out->linesize);
+                ce->out->pts = ce->last_pts = pts;
+                ret = concat_encode(out, index, ce, ce->out);
+            }
+        } else {
+            uint8_t **samples = NULL;
+            int n = (int)av_rescale_rnd(swr_get_delay(ce->swr, ce->dec->sample_rate) + ce->frame->nb_samples,
+                                        ce->enc->sample_rate, ce->dec->sample_rate, AV_ROUND_UP);
+            if (ce->next_pts == AV_NOPTS_VALUE)
+                ce->next_pts = ts != AV_NOPTS_VALUE ? av_rescale_q(ts, in_stream->time_base, ce->enc->time_base) : 0;
+            ret = av_samples_alloc_array_and_samples(&samples, NULL, ce->enc->channels, n, ce->enc->sample_fmt, 0);
+            if (ret >= 0)
+                ret = n = swr_convert(ce->swr, samples, n, (const uint8_t **)ce->frame->extended_data, ce->frame->nb_samples);
+            if (ret >= 0)
+                ret = av_audio_fifo_write(ce->fifo, (void **)samples, n);
+            if (samples)
+                av_freep(&samples[0]);
+            av_freep(&samples);
+            if (ret >= 0)
+                ret = concat_drain_fifo(out, index, ce, 0);
+        }
+        av_frame_unref(ce->frame);
+        if (ret < 0)
+            return ret;
+        if (pkt && dpkt.size <= 0)
+            break;
+    }
+    if (!pkt) {
+        if (ce->fifo && (ret = concat_drain_fifo(out, index, ce, 1)) < 0)
+            return ret;
+        return concat_encode(out, index, ce, NULL);
+    }
+    return 0;
+}
+
+/* Joins the inputs listed in list_filename (one per line) into
+ * out_filename. The first input decides the output streams. */
+static int run_concat(const char *list_filename, const char *out_filename, const RemuxOptions *opt)
+{
+    std::vector<ConcatInput> inputs;
+    std::vector<AVMediaType> out_types;
+    ConcatOutput out;
+    AVFormatContext *ofmt_ctx = NULL;
+    AvioSink *sink = NULL;
+    std::thread prefetch;
+    RemuxStats stats;
+    FILE *f;
+    char line[4096];
+    int64_t offset = 0, start = av_gettime_relative();
+    int ret = 0, failed = 0;
+    size_t k;
+    unsigned i;
+
+    f = fopen(list_filename, "r");
+    if (!f) {
+        printf("Could not open list '%s'\n", list_filename);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        ConcatInput in;
+        line[strcspn(line, "\r\n")] = 0;
+        if (!line[0] || line[0] == '#')
+            continue;
+        in.filename = line;
+        in.source = NULL;
+        in.ic = NULL;
+        in.ret = 0;
+        inputs.push_back(in);
+    }
+    fclose(f);
+    if (inputs.empty()) {
+        printf("List '%s' has no inputs\n", list_filename);
+        return -1;
+    }
+    // the prefetch thread probes, and so opens decoders, while we re-encode
+    if (av_lockmgr_register(mutex_lock_manager) < 0) {
+        printf("Could not register the lock manager\n");
+        return -1;
+    }
+    memset(&stats, 0, sizeof(stats));
+    out.ofmt_ctx = NULL;
+    out.copied = out.encoded = 0;
+
+    concat_open_input(&inputs[0], opt->avio_buffer);
+    if (inputs[0].ret < 0) {
+        printf("Could not open input file %s.\n", inputs[0].filename.c_str());
+        ret = inputs[0].ret;
+        goto end;
+    }
+
+    //Output streams come from the first input
+    avformat_alloc_output_context2(&ofmt_ctx, NULL, NULL, out_filename);
+    if (!ofmt_ctx) {
+        printf("Could not create output context\n");
+        ret = AVERROR_UNKNOWN;
+        goto end;
+    }
+    out.ofmt_ctx = ofmt_ctx;
+    for (i = 0; i < inputs[0].ic->nb_streams; i++) {
+        AVStream *in_stream = inputs[0].ic->streams[i];
+        AVStream *out_stream;
+        if (!stream_wanted(opt->streams, i, in_stream) ||
+            avformat_query_codec(ofmt_ctx->oformat, in_stream->codec->codec_id, FF_COMPLIANCE_NORMAL) == 0)
+            continue;
+        out_stream = avformat_new_stream(ofmt_ctx, in_stream->codec->codec);
+        if (!out_stream || avcodec_copy_context(out_stream->codec, in_stream->codec) < 0) {
+            printf("Failed allocating output stream\n");
+            ret = AVERROR_UNKNOWN;
+            goto end;
+        }
+        out_stream->codec->codec_tag = 0;
+        if (ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+            out_stream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+        out_stream->time_base = in_stream->time_base;
+        out_stream->avg_frame_rate = in_stream->avg_frame_rate;
+        out_types.push_back(in_stream->codec->codec_type);
+    }
+    if (out_types.empty()) {
+        printf("No stream selected\n");
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        sink = AvioSink::openFile(out_filename, opt->avio_buffer);
+        if (!sink) {
+            printf("Could not open output file '%s'\n", out_filename);
+            ret = AVERROR(EIO);
+            goto end;
+        }
+        ofmt_ctx->pb = sink->context();
+    }
+    if ((ret = avformat_write_header(ofmt_ctx, NULL)) < 0) {
+        printf("Error occurred when opening output file\n");
+        goto end;
+    }
+    out.last_dts.assign(ofmt_ctx->nb_streams, AV_NOPTS_VALUE);
+    out.default_duration.assign(ofmt_ctx->nb_streams, 0);
+    for (i = 0; i < ofmt_ctx->nb_streams; i++) {
+        AVStream *st = ofmt_ctx->streams[i];
+        if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO && st->avg_frame_rate.num)
+            out.default_duration[i] = av_rescale_q(1, av_inv_q(st->avg_frame_rate), st->time_base);
+        else if (st->codec->codec_type == AVMEDIA_TYPE_AUDIO && st->codec->frame_size && st->codec->sample_rate)
+            out.default_duration[i] = av_rescale_q(st->codec->frame_size, (AVRational){1, st->codec->sample_rate}, st->time_base);
+    }
+
+    for (k = 0; k < inputs.size() && ret >= 0; k++) {
+        ConcatInput *in = &inputs[k];
+        std::vector<int> map;                   // input stream -> output stream
+        std::vector<ConcatEncoder *> encoders;  // per input stream, NULL when copied
+        std::vector<int> type_seen(AVMEDIA_TYPE_NB, 0);
+        int64_t in_start;
+        AVPacket pkt;
+
+        if (prefetch.joinable())
+            prefetch.join();
+        // open the next input while this one is copied
+        if (k + 1 < inputs.size())
+            prefetch = std::thread(concat_open_input, &inputs[k + 1], opt->avio_buffer);
+        if (in->ret < 0) {
+            printf("Skipping %s: could not open it\n", in->filename.c_str());
+            concat_close_input(in);
+            failed++;
+            continue;
+        }
+
+        //The n-th selected stream of a type goes to the n-th output stream of that type
+        map.assign(in->ic->nb_streams, -1);
+        encoders.assign(in->ic->nb_streams, NULL);
+        for (i = 0; i < in->ic->nb_streams; i++) {
+            AVStream *st = in->ic->streams[i];
+            enum AVMediaType type = st->codec->codec_type;
+            int nth, j;
+            if (type < 0 || type >= AVMEDIA_TYPE_NB || !stream_wanted(opt->streams, i, st))
+                continue;
+            nth = type_seen[type]++;
+            for (j = 0; j < (int)out_types.size(); j++) {
+                if (out_types[j] == type && nth-- == 0)
+                    break;
+            }
+            if (j == (int)out_types.size())
+                continue;
+            if (!concat_copyable(ofmt_ctx->streams[j]->codec, st->codec)) {
+                if (type == AVMEDIA_TYPE_VIDEO && !concat_can_reencode_video(ofmt_ctx)) {
+                    printf("%s: video stream %u does not match the first input. A re-encoded segment cannot go\n"
+                           "into a %s output, whose header holds the first input's codec configuration;\n"
+                           "join into an MPEG-TS output (.ts) or use inputs encoded with the same settings\n",
+                           in->filename.c_str(), i, ofmt_ctx->oformat->name);
+                    ret = AVERROR(EINVAL);
+                    break;
+                }
+                if (type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO) {
+                    printf("%s: stream %u does not match the output and cannot be re-encoded, dropped\n", in->filename.c_str(), i);
+                    continue;
+                }
+                encoders[i] = concat_open_encoder(st, ofmt_ctx->streams[j], ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER);
+                if (!encoders[i])
+                    continue;
+                printf("%s: stream %u re-encoded to match the output\n", in->filename.c_str(), i);
+            }
+            map[i] = j;
+        }
+        if (ret < 0) {
+            for (i = 0; i < in->ic->nb_streams; i++)
+                concat_free_encoder(encoders[i]);
+            concat_close_input(in);
+            break;
+        }
+
+        //Continue the timeline where the previous input ended
+        in_start = in->ic->start_time != AV_NOPTS_VALUE ? in->ic->start_time : 0;
+        out.segment_end = offset;
+        while ((ret = av_read_frame(in->ic, &pkt)) >= 0) {
+            int j = pkt.stream_index < (int)map.size() ? map[pkt.stream_index] : -1;
+            AVStream *in_stream;
+            int64_t delta;
+            if (j < 0) {
+                av_free_packet(&pkt);
+                continue;
+            }
+            in_stream = in->ic->streams[pkt.stream_index];
+            delta = av_rescale_q(offset - in_start, AV_TIME_BASE_Q, in_stream->time_base);
+            if (encoders[pkt.stream_index]) {
+                ret = concat_transcode(&out, j, encoders[pkt.stream_index], in_stream, &pkt, delta);
+                av_free_packet(&pkt);
+            } else {
+                if (pkt.pts != AV_NOPTS_VALUE)
+                    pkt.pts += delta;
+                if (pkt.dts != AV_NOPTS_VALUE)
+                    pkt.dts += delta;
+                av_packet_rescale_ts(&pkt, in_stream->time_base, ofmt_ctx->streams[j]->time_base);
+                out.copied++;
+                ret = concat_write(&out, j, &pkt);
+            }
+            if (ret < 0)
+                break;
+        }
+        if (ret == AVERROR_EOF)
+            ret = 0;
+        for (i = 0; i < in->ic->nb_streams; i++) {
+            if (encoders[i] && ret >= 0) {
+                AVStream *in_stream = in->ic->streams[i];
+                ret = concat_transcode(&out, map[i], encoders[i], in_stream, NULL,
+                                       av_rescale_q(offset - in_start, AV_TIME_BASE_Q, in_stream->time_base));
+            }
+            concat_free_encoder(encoders[i]);
+        }
+        if (ret < 0)
+            printf("Error muxing %s\n", in->filename.c_str());
+        offset = FFMAX(offset, out.segment_end);
+        if (in->source)
+            stats.bytes_in += in->source->bytesRead();
+        concat_close_input(in);
+    }
+    if (prefetch.joinable())
+        prefetch.join();
+
+    if (ret >= 0) {
+        ret = av_write_trailer(ofmt_ctx);
+        if (ret >= 0 && sink)
+            ret = sink->finish();
+        if (sink)
+            stats.bytes_out = avio_size(sink->context());
+    }
+
+end:
+    if (prefetch.joinable())
+        prefetch.join();
+    for (k = 0; k < inputs.size(); k++)
+        concat_close_input(&inputs[k]);
+    avformat_free_context(ofmt_ctx);
+    av_lockmgr_register(NULL);
+    if (ret < 0 && sink)
+        unlink(out_filename);
+    delete sink;
+    if (ret < 0)
+        return ret;
+
+    stats.packets = out.copied + out.encoded;
+    stats.time = av_gettime_relative() - start;
+    printf("Joined %d of %d inputs, %.3fs, %ld packets copied, %ld re-encoded\n",
+           (int)inputs.size() - failed, (int)inputs.size(), offset / 1000000.0, out.copied, out.encoded);
+    print_stats(out_filename, &stats);
+    return 0;
+}
+
+/* Concat self-check */
+
+#define CONCAT_CHECK_FRAMES 25
+
+// writes a short synthetic clip with the default video codec of the container filename names
+static int concat_check_write(const char *filename, int width, int height)
+{
+    AVFormatContext *oc = NULL;
+    AVCodec *codec;
+    AVStream *st = NULL;
+    AVCodecContext *c = NULL;
+    AVFrame *frame = NULL;
+    AVPacket pkt;
+    int i, x, y, got, ret;
+
+    avformat_alloc_output_context2(&oc, NULL, NULL, filename);
+    if (!oc)
+        return AVERROR_UNKNOWN;
+    codec = avcodec_find_encoder(oc->oformat->video_codec);
+    if (codec)
+        st = avformat_new_stream(oc, codec);
+    if (!st) {
+        ret = AVERROR_ENCODER_NOT_FOUND;
+        goto end;
+    }
+    c = st->codec;
+    c->codec_id  = codec->id;
+    c->width     = width;
+    c->height    = height;
+    c->pix_fmt   = AV_PIX_FMT_YUV420P;
+    c->time_base = (AVRational){1, 25};
+    c->gop_size  = 12;
+    c->bit_rate  = 400000;
+    st->time_base = c->time_base;
+    if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+        c->flags |= CODEC_FLAG_GLOBAL_HEADER;
+    if ((ret = avcodec_open2(c, codec, NULL)) < 0 ||
+        (ret = avio_open(&oc->pb, filename, AVIO_FLAG_WRITE)) < 0 ||
+        (ret = avformat_write_header(oc, NULL)) < 0)
+        goto end;
+
+    frame = av_frame_alloc();
+    if (!frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    frame->format = c->pix_fmt;
+    frame->width  = width;
+    frame->height = height;
+    if ((ret = av_frame_get_buffer(frame, 32)) < 0)
+        goto end;
+    // one more round without a frame drains the encoder
+    for (i = 0; i <= CONCAT_CHECK_FRAMES && ret >= 0; i++) {
+        AVFrame *in = NULL;
+        if (i < CONCAT_CHECK_FRAMES) {
+            if ((ret = av_frame_make_writable(frame)) < 0)
+                break;
+            for (y = 0; y < height; y++)
+                for (x = 0; x < width; x++)
+                    frame->data[0][y * frame->linesize[0] + x] = x + y + i * 3;
+            for (y = 0; y < height / 2; y++) {
+                for (x = 0; x < width / 2; x++) {
+                    frame->data[1][y * frame->linesize[1] + x] = 128 + y + i * 2;
+                    frame->data[2][y * frame->linesize[2] + x] = 64 + x + i * 5;
+                }
+            }
+            frame->pts = i;
+            in = frame;
+        }
+        do {
+            av_init_packet(&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+            if ((ret = avcodec_encode_video2(c, &pkt, in, &got)) < 0 || !got)
+                break;
+            av_packet_rescale_ts(&pkt, c->time_base, st->time_base);
+            pkt.stream_index = st->index;
+            ret = av_interleaved_write_frame(oc, &pkt);
+        } while (!in && ret >= 0);
+    }
+    if (ret >= 0)
+        ret = av_write_trailer(oc);
+end:
+    av_frame_free(&frame);
+    if (c)
+        avcodec_close(c);
+    if (oc->pb)
+        avio_closep(&oc->pb);
+    avformat_free_context(oc);
+    return ret;
+}
+
+// decodes the video of filename, returns the number of frames or an error
+static int concat_check_decode(const char *filename)
+{
+    AVFormatContext *ic = NULL;
+    AVCodec *codec = NULL;
+    AVCodecContext *dec = NULL;
+    AVFrame *frame = av_frame_alloc();
+    AVPacket pkt;
+    int video, got, frames = 0, errors = 0, ret;
+
+    if (!frame)
+        return AVERROR(ENOMEM);
+    if ((ret = avformat_open_input(&ic, filename, NULL, NULL)) < 0)
+        goto end;
+    if ((ret = avformat_find_stream_info(ic, NULL)) < 0 ||
+        (ret = video = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0)) < 0)
+        goto end;
+    dec = ic->streams[video]->codec;
+    if ((ret = avcodec_open2(dec, codec, NULL)) < 0) {
+        dec = NULL;
+        goto end;
+    }
+    while (av_read_frame(ic, &pkt) >= 0) {
+        if (pkt.stream_index == video) {
+            if (avcodec_decode_video2(dec, frame, &got, &pkt) < 0)
+                errors++;
+            else if (got)
+                frames++;
+            av_frame_unref(frame);
+        }
+        av_free_packet(&pkt);
+    }
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+    while (avcodec_decode_video2(dec, frame, &got, &pkt) >= 0 && got) {
+        frames++;
+        av_frame_unref(frame);
+    }
+    ret = errors ? AVERROR_INVALIDDATA : frames;
+end:
+    if (dec)
+        avcodec_close(dec);
+    avformat_close_input(&ic);
+    av_frame_free(&frame);
+    return ret;
+}
+
+/* Joins synthetic clips the three ways that matter: identical mp4 clips
+ * are copied, an mp4 clip with different video is refused for an mp4
+ * output, and the same mismatch is re-encoded into an MPEG-TS output. The
+ * joined files must decode completely. Returns the number of failed cases. */
+static int run_concat_check(const RemuxOptions *opt)
+{
+    static const struct { const char *filename; int width, height; } clips[] = {
+        { "concat_check_a.mp4", 320, 240 },
+        { "concat_check_b.mp4", 320, 240 },
+        { "concat_check_c.mp4", 352, 288 },
+        { "concat_check_a.ts",  320, 240 },
+        { "concat_check_c.ts",  352, 288 },
+    };
+    static const struct { const char *first, *second, *output; int joins; } cases[] = {
+        { "concat_check_a.mp4", "concat_check_b.mp4", "concat_check_ab.mp4", 1 },
+        { "concat_check_a.mp4", "concat_check_c.mp4", "concat_check_ac.mp4", 0 },
+        { "concat_check_a.ts",  "concat_check_c.ts",  "concat_check_ac.ts",  1 },
+    };
+    const char *list_filename = "concat_check.txt";
+    int failed = 0, ret;
+    size_t i;
+
+    for (i = 0; i < sizeof(clips) / sizeof(clips[0]) && !failed; i++) {
+        if ((ret = concat_check_write(clips[i].filename, clips[i].width, clips[i].height)) < 0) {
+            printf("Could not write %s: %s\n", clips[i].filename, av_err2str(ret));
+            failed = (int)(sizeof(cases) / sizeof(cases[0]));
+        }
+    }
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]) && !failed; i++) {
+        FILE *f = fopen(list_filename, "w");
+        int ok;
+        if (!f) {
+            printf("Could not write %s\n", list_filename);
+            failed++;
+            continue;
+        }
+        fprintf(f, "%s\n%s\n", cases[i].first, cases[i].second);
+        fclose(f);
+        printf("\n== %s + %s -> %s\n", cases[i].first, cases[i].second, cases[i].output);
+        ret = run_concat(list_filename, cases[i].output, opt);
+        if (cases[i].joins) {
+            int frames = ret < 0 ? ret : concat_check_decode(cases[i].output);
+            ok = frames == 2 * CONCAT_CHECK_FRAMES;
+            printf("%s: %s, %d of %d frames decoded\n", cases[i].output, ok ? "ok" : "FAILED",
+                   FFMAX(frames, 0), 2 * CONCAT_CHECK_FRAMES);
+        } else {
+            ok = ret < 0 && access(cases[i].output, F_OK) != 0;
+            printf("%s: %s\n", cases[i].output, ok ? "ok, refused" : "FAILED, should have been refused");
+        }
+        failed += !ok;
+        unlink(cases[i].output);
+    }
+    for (i = 0; i < sizeof(clips) / sizeof(clips[0]); i++)
+        unlink(clips[i].filename);
+    unlink(list_filename);
+    printf("\n%d of %d concat checks failed\n", failed, (int)(sizeof(cases) / sizeof(cases[0])));
+    return failed;
+}
+
+static bool read_file(const char *filename, std::vector<uint8_t>& data)
+{
+    FILE *f = fopen(filename, "rb");
+    uint8_t buf[65536];
+    size_t n;
+
+    if (!f)
+        return false;
+    data.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    n = ferror(f);
+    fclose(f);
+    return n == 0;
+}
+
+/* -memory: the file is only read before and written after, the remux
+ * itself runs through remux_memory() like an embedding service would. */
+static int remux_file_in_memory(const char *in_filename, const char *out_filename, const RemuxOptions *opt, RemuxStats *stats)
+{
+    AVOutputFormat *ofmt = av_guess_format(NULL, out_filename, NULL);
+    std::vector<uint8_t> in, out;
+    FILE *f;
+    int ret;
+
+    if (!ofmt) {
+        printf("Could not guess the output format of %s\n", out_filename);
+        return AVERROR_MUXER_NOT_FOUND;
+    }
+    if (!read_file(in_filename, in)) {
+        printf("Could not read input file %s.\n", in_filename);
+        return AVERROR(EIO);
+    }
+    if ((ret = remux_memory(in.data(), in.size(), ofmt->name, out, opt, stats)) < 0)
+        return ret;
+    f = fopen(out_filename, "wb");
+    if (!f) {
+        printf("Could not open output file '%s'\n", out_filename);
+        return AVERROR(EIO);
+    }
+    ret = fwrite(out.data(), 1, out.size(), f) == out.size() ? 0 : AVERROR(EIO);
+    if (fclose(f) != 0)
+        ret = AVERROR(EIO);
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    const char *in_filename  = "cuc_ieschool1.flv";//Input file URL
+    const char *out_filename = "cuc_ieschool1.mp4";//Output file URL
+    const char *manifest = NULL;
+    const char *concat_list = NULL;
+    RemuxOptions opt;
+    RemuxStats stats;
+    int nb_workers = 0, max_open = 0;
+    int i, first_option = 3, ret;
+
+    opt.streams = "all";
+    opt.avio_buffer = AVIO_SOURCE_DEFAULT_BUFFER;
+    opt.start_time = AV_NOPTS_VALUE;
+    opt.end_time = AV_NOPTS_VALUE;
+    opt.smart = 0;
+    opt.memory = 0;
+
+    if (argc == 2 && !strcmp(argv[1], "-check_concat")) {
+        av_register_all();
+        return run_concat_check(&opt) == 0 ? 0 : 1;
+    }
+    if (argc == 2) {
+        printf("usage: %s input_file output_file [-streams all|vasd|0,1,...] [-ss start] [-to end] [-smart on|off] [-memory on|off] [-avio_buffer bytes]\n"
+               "       %s -batch manifest [-workers n] [-max_open n] [-streams ...] [-avio_buffer bytes]\n"
+               "       %s -concat list_file output_file [-streams ...] [-avio_buffer bytes]\n"
+               "       %s -check_concat\n"
+               "Copies the selected streams into a new container without decoding.\n"
+               "-streams picks streams by type (v, a, s, d) or by index.\n"
+               "-ss/-to cut out a time range ([HH:]MM:SS[.m] or seconds); the cut starts at the keyframe\n"
+               "before -ss and uses the input's .kfi keyframe index if there is one.\n"
+               "-smart on makes the cut frame accurate by re-encoding only the partial GOPs at the\n"
+               "cut points (H.264/HEVC with in band parameter sets, e.g. from MPEG-TS).\n"
+               "-memory on reads the whole input first and remuxes it from memory into memory,\n"
+               "the way remux_memory() is used by a service that has the object in a buffer.\n"
+               "-batch remuxes every \"input<TAB>output\" line of the manifest on -workers threads\n"
+               "(default: one per CPU), with at most -max_open files open at once (default: 2 per worker).\n"
+               "-concat joins the inputs listed one per line in list_file, copying every stream that\n"
+               "matches the first input and re-encoding the others; video is only re-encoded into\n"
+               "outputs without a global header, such as MPEG-TS.\n"
+               "-check_concat joins synthetic clips in the current directory and checks the results.\n",
+               argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    if (argc > 2) {
+        if (!strcmp(argv[1], "-batch")) {
+            manifest = argv[2];
+        } else if (!strcmp(argv[1], "-concat")) {
+            if (argc < 4) {
+                printf("-concat needs a list file and an output file\n");
+                return 1;
+            }
+            concat_list = argv[2];
+            out_filename = argv[3];
+            first_option = 4;
+        } else {
+            in_filename = argv[1];
+            out_filename = argv[2];
+        }
+    }
+    for (i = first_option; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-streams")) {
+            opt.streams = argv[i+1];
+        } else if (!strcmp(argv[i], "-avio_buffer")) {
+            opt.avio_buffer = atoi(argv[i+1]);
+            if (opt.avio_buffer <= 0) {
+                printf("Invalid AVIO buffer size '%s'\n", argv[i+1]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "-ss") || !strcmp(argv[i], "-to")) {
+            int64_t t;
+            if (av_parse_time(&t, argv[i+1], 1) < 0 || t < 0) {
+                printf("Invalid time '%s'\n", argv[i+1]);
+                return 1;
+            }
+            if (argv[i][1] == 's')
+                opt.start_time = t;
+            else
+                opt.end_time = t;
+        } else if (!strcmp(argv[i], "-smart")) {
+            opt.smart = !strcmp(argv[i+1], "on") || !strcmp(argv[i+1], "1");
+        } else if (!manifest && !concat_list && !strcmp(argv[i], "-memory")) {
+            opt.memory = !strcmp(argv[i+1], "on") || !strcmp(argv[i+1], "1");
+        } else if (manifest && !strcmp(argv[i], "-workers")) {
+            nb_workers = atoi(argv[i+1]);
+        } else if (manifest && !strcmp(argv[i], "-max_open")) {
+            max_open = atoi(argv[i+1]);
+        } else {
+            printf("Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (opt.start_time != AV_NOPTS_VALUE && opt.end_time != AV_NOPTS_VALUE && opt.end_time <= opt.start_time) {
+        printf("-to must be after -ss\n");
+        return 1;
+    }
+
+    av_register_all();
+
+    if (manifest) {
+        if (nb_workers <= 0)
+            nb_workers = ThreadPool::defaultThreadCount();
+        if (max_open <= 0)
+            max_open = 2 * nb_workers;
+        return run_batch(manifest, &opt, nb_workers, max_open) == 0 ? 0 : -1;
+    }
+    if (concat_list) {
+        if (run_concat(concat_list, out_filename, &opt) < 0) {
+            printf("Error occurred.\n");
+            return -1;
+        }
+        return 0;
+    }
+    if (opt.memory)
+        ret = remux_file_in_memory(in_filename, out_filename, &opt, &stats);
+    else
+        ret = remux(in_filename, out_filename, &opt, &stats);
+    if (ret < 0) {
+        printf("Error occurred.\n");
+        return -1;
+    }
+    print_stats(out_filename, &stats);
     return 0;
 }
@@ -0,0 +1,702 @@
+/**
+ * 封装格式转换核心
+ * Remux core of the Simplest FFmpeg Remuxer
+ *
+ * The packet copy itself, with stream selection, -ss/-to cuts and the
+ * smart render, between files, memory buffers or caller supplied
+ * callbacks. main.cpp only adds the command line, batch and concat modes
+ * on top; remux.h is all an embedding program needs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+
+#define __STDC_CONSTANT_MACROS
+
+#ifdef _WIN32
+//Windows
+extern "C"
+{
+#include "libavformat/avformat.h"
+#include "libavutil/time.h"
+#include "libavutil/opt.h"
+};
+#else
+//Linux...
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "libavformat/avformat.h"
+#include "libavutil/time.h"
+#include "libavutil/opt.h"
+#ifdef __cplusplus
+};
+#endif
+#endif
+#include "remux.h"
+#include "../../common/keyframe_index.h"
+
+int stream_wanted(const char *sel, int index, const AVStream *st)
+{
+    if (!strcmp(sel, "all"))
+        return 1;
+    if (sel[0] >= '0' && sel[0] <= '9') {
+        const char *p = sel;
+        while (*p) {
+            char *end;
+            long i = strtol(p, &end, 10);
+            if (end == p)
+                return 0;
+            if (i == index)
+                return 1;
+            p = *end == ',' ? end + 1 : end;
+        }
+        return 0;
+    }
+    switch (st->codec->codec_type) {
+        case AVMEDIA_TYPE_VIDEO:    return strchr(sel, 'v') != NULL;
+        case AVMEDIA_TYPE_AUDIO:    return strchr(sel, 'a') != NULL;
+        case AVMEDIA_TYPE_SUBTITLE: return strchr(sel, 's') != NULL;
+        case AVMEDIA_TYPE_DATA:     return strchr(sel, 'd') != NULL;
+        default:                    return 0;
+    }
+}
+
+/* Seeks to the keyframe at or before start (AV_TIME_BASE, absolute). A
+ * keyframe index sidecar next to the input, if there is a current one,
+ * gives the byte position directly; otherwise libavformat seeks with the
+ * container's index, or by bisecting the file for MPEG-TS. */
+static int seek_to_start(AVFormatContext *ic, const char *filename, int64_t start)
+{
+    int video = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    KeyframeIndex index;
+
+    // inputs that are not files have no sidecar
+    if (video >= 0 && filename && index.load(KeyframeIndex::sidecarName(filename).c_str(), video) && index.matches(ic)) {
+        AVStream *st = ic->streams[video];
+        if (index.seek(ic, video, av_rescale_q(start, AV_TIME_BASE_Q, st->time_base)) >= 0)
+            return 0;
+    }
+    return avformat_seek_file(ic, -1, INT64_MIN, start, start, 0);
+}
+
+/* Smart render: frame accurate cuts on one video stream.
+ *
+ *   HEAD  decode from the keyframe before the start and re-encode the
+ *         frames from the start up to the next keyframe;
+ *   COPY  copy whole GOPs; a GOP is held back until the next keyframe
+ *         shows it ends before the end point, otherwise (the tail) it is
+ *         decoded and re-encoded up to the end point.
+ *
+ * Each re-encoded segment gets its own encoder, so it starts with an IDR
+ * carrying its parameter sets in band, and has no B-frames. Its dts are
+ * the pts minus the source's decode delay, which keeps them increasing
+ * across the splices. Closed GOPs are assumed: leading pictures of the
+ * first copied GOP, which would refer to frames before it, are dropped. */
+struct SmartCut {
+    AVFormatContext *ofmt_ctx;
+    AVStream *in_stream, *out_stream;
+    AVCodecContext *dec, *enc;
+    AVFrame *frame;
+    int64_t start, end;         // cut points, in the stream time base
+    int64_t shift;              // subtracted from every timestamp to start the output at zero
+    int64_t delay;              // source pts - dts at its keyframes
+    std::deque<int64_t> enc_pts; // source pts of the frames inside the encoder
+    enum { HEAD, COPY, DONE } state;
+    int seen_key;
+    int64_t leading_before;     // COPY: drop pictures before this pts, AV_NOPTS_VALUE once past
+    std::vector<AVPacket> gop;  // COPY: the current GOP, not written yet
+    long copied, reencoded;
+};
+
+// stream copy is only spliceable when both sides are Annex B with in band parameter sets
+static int smart_supported(const AVStream *st)
+{
+    const AVCodecContext *c = st->codec;
+    if (c->codec_id != AV_CODEC_ID_H264 && c->codec_id != AV_CODEC_ID_HEVC)
+        return 0;
+    // avcC/hvcC extradata (MP4, MKV, FLV) starts with version 1
+    return !(c->extradata_size > 0 && c->extradata[0] == 1);
+}
+
+static int smart_write(SmartCut *sc, AVPacket *pkt)
+{
+    if (pkt->pts != AV_NOPTS_VALUE)
+        pkt->pts -= sc->shift;
+    if (pkt->dts != AV_NOPTS_VALUE)
+        pkt->dts -= sc->shift;
+    av_packet_rescale_ts(pkt, sc->in_stream->time_base, sc->out_stream->time_base);
+    pkt->stream_index = sc->out_stream->index;
+    pkt->pos = -1;
+    return av_interleaved_write_frame(sc->ofmt_ctx, pkt);
+}
+
+// an encoder for one re-encoded segment, set up like the source stream
+static int smart_open_encoder(SmartCut *sc)
+{
+    const AVCodecContext *src = sc->in_stream->codec;
+    AVCodec *codec = avcodec_find_encoder(src->codec_id);
+    AVRational rate = sc->in_stream->avg_frame_rate.num ? sc->in_stream->avg_frame_rate : sc->in_stream->r_frame_rate;
+    AVCodecContext *c;
+
+    if (!codec) {
+        printf("No %s encoder for smart render\n", avcodec_get_name(src->codec_id));
+        return AVERROR_ENCODER_NOT_FOUND;
+    }
+    c = avcodec_alloc_context3(codec);
+    if (!c)
+        return AVERROR(ENOMEM);
+    c->width               = src->width;
+    c->height              = src->height;
+    c->pix_fmt             = sc->dec->pix_fmt;
+    c->sample_aspect_ratio = src->sample_aspect_ratio;
+    c->colorspace          = src->colorspace;
+    c->color_range         = src->color_range;
+    c->bit_rate            = src->bit_rate;
+    c->profile             = src->profile;
+    c->level               = src->level;
+    // rate control wants the frame rate, timestamps are mapped back through enc_pts
+    c->time_base           = rate.num ? av_inv_q(rate) : sc->in_stream->time_base;
+    c->gop_size            = 0x7fffffff;
+    c->max_b_frames        = 0;
+    // no global header: the IDR carries its own parameter sets
+    if (avcodec_open2(c, codec, NULL) < 0) {
+        printf("Could not open the %s encoder for smart render\n", codec->name);
+        avcodec_free_context(&c);
+        return AVERROR_UNKNOWN;
+    }
+    sc->enc = c;
+    return 0;
+}
+
+// encodes frame (NULL drains the encoder) and writes what comes out
+static int smart_encode(SmartCut *sc, AVFrame *frame)
+{
+    AVPacket opkt;
+    int got, ret;
+
+    if (!sc->enc) {
+        if (!frame)
+            return 0;
+        if ((ret = smart_open_encoder(sc)) < 0)
+            return ret;
+    }
+    if (frame) {
+        sc->enc_pts.push_back(frame->pts);
+        frame->pts = av_rescale_q(frame->pts, sc->in_stream->time_base, sc->enc->time_base);
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+    }
+    do {
+        av_init_packet(&opkt);
+        opkt.data = NULL;
+        opkt.size = 0;
+        if ((ret = avcodec_encode_video2(sc->enc, &opkt, frame, &got)) < 0)
+            return ret;
+        if (!got)
+            break;
+        // no B-frames: packets come out in the order the frames went in
+        opkt.pts = sc->enc_pts.front();
+        sc->enc_pts.pop_front();
+        opkt.dts = opkt.pts - sc->delay;
+        opkt.duration = 0;
+        sc->reencoded++;
+        if ((ret = smart_write(sc, &opkt)) < 0)
+            return ret;
+    } while (!frame);
+    return 0;
+}
+
+// decodes pkt (NULL drains the decoder) and re-encodes the frames inside the cut
+static int smart_decode(SmartCut *sc, AVPacket *pkt)
+{
+    AVPacket dpkt;
+    int got, ret;
+
+    if (pkt) {
+        dpkt = *pkt;
+    } else {
+        av_init_packet(&dpkt);
+        dpkt.data = NULL;
+        dpkt.size = 0;
+    }
+    do {
+        if (avcodec_decode_video2(sc->dec, sc->frame, &got, &dpkt) < 0)
+            return 0;       // a broken packet only costs its own frame
+        if (!got)
+            break;
+        int64_t pts = av_frame_get_best_effort_timestamp(sc->frame);
+        ret = 0;
+        if (pts != AV_NOPTS_VALUE && pts >= sc->start && pts < sc->end) {
+            sc->frame->pts = pts;
+            ret = smart_encode(sc, sc->frame);
+        }
+        av_frame_unref(sc->frame);
+        if (ret < 0)
+            return ret;
+    } while (!pkt);
+    return 0;
+}
+
+// finishes a re-encoded segment and readies the decoder for the next one
+static int smart_end_segment(SmartCut *sc)
+{
+    int ret = smart_decode(sc, NULL);
+    if (ret >= 0)
+        ret = smart_encode(sc, NULL);
+    avcodec_free_context(&sc->enc);
+    sc->enc_pts.clear();
+    avcodec_flush_buffers(sc->dec);
+    return ret;
+}
+
+static void smart_drop_gop(SmartCut *sc)
+{
+    for (size_t i = 0; i < sc->gop.size(); i++)
+        av_free_packet(&sc->gop[i]);
+    sc->gop.clear();
+}
+
+static int smart_copy_gop(SmartCut *sc)
+{
+    int ret = 0;
+    for (size_t i = 0; i < sc->gop.size() && ret >= 0; i++) {
+        sc->copied++;
+        ret = smart_write(sc, &sc->gop[i]);
+    }
+    smart_drop_gop(sc);
+    return ret;
+}
+
+// the held back GOP crosses the end point: re-encode it up to there
+static int smart_encode_tail(SmartCut *sc)
+{
+    int ret = 0;
+    for (size_t i = 0; i < sc->gop.size() && ret >= 0; i++)
+        ret = smart_decode(sc, &sc->gop[i]);
+    if (ret >= 0)
+        ret = smart_end_segment(sc);
+    smart_drop_gop(sc);
+    sc->state = SmartCut::DONE;
+    return ret;
+}
+
+static int smart_open(SmartCut *sc, AVFormatContext *ofmt_ctx, AVStream *in_stream, AVStream *out_stream,
+                      int64_t start_ts, int64_t end_ts)
+{
+    AVCodec *codec = avcodec_find_decoder(in_stream->codec->codec_id);
+
+    sc->ofmt_ctx   = ofmt_ctx;
+    sc->in_stream  = in_stream;
+    sc->out_stream = out_stream;
+    sc->start = start_ts != AV_NOPTS_VALUE ? av_rescale_q(start_ts, AV_TIME_BASE_Q, in_stream->time_base) : INT64_MIN;
+    sc->end   = end_ts != AV_NOPTS_VALUE ? av_rescale_q(end_ts, AV_TIME_BASE_Q, in_stream->time_base) : INT64_MAX;
+    sc->shift = start_ts != AV_NOPTS_VALUE ? sc->start : 0;
+    sc->delay = 0;
+    sc->state = SmartCut::HEAD;
+    sc->seen_key = 0;
+    sc->leading_before = AV_NOPTS_VALUE;
+    sc->copied = sc->reencoded = 0;
+    sc->enc = NULL;
+    sc->frame = av_frame_alloc();
+    sc->dec = codec ? avcodec_alloc_context3(codec) : NULL;
+    if (!sc->frame || !sc->dec || avcodec_copy_context(sc->dec, in_stream->codec) < 0 ||
+        avcodec_open2(sc->dec, codec, NULL) < 0) {
+        printf("Could not open the %s decoder for smart render\n", avcodec_get_name(in_stream->codec->codec_id));
+        return AVERROR_DECODER_NOT_FOUND;
+    }
+    sc->dec->refcounted_frames = 1;
+    return 0;
+}
+
+static void smart_close(SmartCut *sc)
+{
+    smart_drop_gop(sc);
+    avcodec_free_context(&sc->enc);
+    avcodec_free_context(&sc->dec);
+    av_frame_free(&sc->frame);
+}
+
+// takes over pkt, a packet of the video stream read before the end point
+static int smart_video_packet(SmartCut *sc, AVPacket *pkt)
+{
+    int key = pkt->flags & AV_PKT_FLAG_KEY;
+    int ret = 0;
+
+    if (sc->state == SmartCut::DONE || (!sc->seen_key && !key)) {
+        av_free_packet(pkt);
+        return 0;
+    }
+    if (key && pkt->pts != AV_NOPTS_VALUE && pkt->dts != AV_NOPTS_VALUE)
+        sc->delay = pkt->pts - pkt->dts;
+
+    if (sc->state == SmartCut::HEAD) {
+        // the first keyframe at or after the start: the rest is whole GOPs
+        if (!(key && pkt->pts != AV_NOPTS_VALUE && (sc->seen_key ? pkt->pts > sc->start : pkt->pts >= sc->start))) {
+            sc->seen_key = 1;
+            ret = smart_decode(sc, pkt);
+            av_free_packet(pkt);
+            return ret;
+        }
+        if (sc->seen_key && (ret = smart_end_segment(sc)) < 0) {
+            av_free_packet(pkt);
+            return ret;
+        }
+        sc->leading_before = pkt->pts;
+        sc->seen_key = 1;
+        sc->state = SmartCut::COPY;
+    }
+
+    if (key && !sc->gop.empty()) {
+        // the held back GOP ends before this keyframe
+        if (pkt->pts == AV_NOPTS_VALUE || pkt->pts <= sc->end) {
+            ret = smart_copy_gop(sc);
+        } else {
+            av_free_packet(pkt);
+            return smart_encode_tail(sc);
+        }
+        sc->leading_before = AV_NOPTS_VALUE;
+    }
+    if (!key && sc->leading_before != AV_NOPTS_VALUE && pkt->pts != AV_NOPTS_VALUE && pkt->pts < sc->leading_before) {
+        av_free_packet(pkt);
+        return ret;
+    }
+    if (av_dup_packet(pkt) < 0) {
+        av_free_packet(pkt);
+        return AVERROR(ENOMEM);
+    }
+    sc->gop.push_back(*pkt);
+    return ret;
+}
+
+/* No more video before the end point. reached_end says whether the end
+ * point cut the last GOP, or the input simply ended. */
+static int smart_finish(SmartCut *sc, int reached_end)
+{
+    int ret = 0;
+    if (sc->state == SmartCut::HEAD)
+        ret = smart_end_segment(sc);
+    else if (sc->state == SmartCut::COPY)
+        ret = reached_end ? smart_encode_tail(sc) : smart_copy_gop(sc);
+    sc->state = SmartCut::DONE;
+    return ret;
+}
+
+// bytes written so far; a sink that cannot seek cannot report its size
+static int64_t sink_bytes(AvioSink *sink)
+{
+    int64_t size = avio_size(sink->context());
+    return size >= 0 ? size : avio_tell(sink->context());
+}
+
+/* Copies the selected streams of the input read through source into the
+ * output. out_sink may be NULL, out_filename is then written as a file.
+ * out_format names the container, NULL picks it from out_filename's
+ * extension. in_filename is only used for messages and to find a keyframe
+ * index sidecar, NULL when the input is not a file. */
+static int remux_io(AvioSource *source, const char *in_filename, AvioSink *out_sink,
+                    const char *out_filename, const char *out_format, const RemuxOptions *opt, RemuxStats *stats)
+{
+    AVFormatContext *ifmt_ctx = NULL, *ofmt_ctx = NULL;
+    AvioSink *sink = out_sink;
+    AVDictionary *header_opts = NULL;
+    const char *in_name = in_filename ? in_filename : "input";
+    std::vector<int> stream_map;
+    // trimming, per input stream: the first keyframe was seen, reading waits for it to reach the end
+    std::vector<char> started, wait_end;
+    int64_t start_ts = AV_NOPTS_VALUE, end_ts = AV_NOPTS_VALUE, offset = AV_NOPTS_VALUE;
+    SmartCut smart;
+    int smart_stream = -1;
+    AVPacket pkt;
+    int64_t start = av_gettime_relative();
+    int ret, nb_out = 0, nb_running = 0;
+    unsigned i;
+
+    memset(stats, 0, sizeof(*stats));
+
+    //Input
+    ifmt_ctx = avformat_alloc_context();
+    if (!ifmt_ctx) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    ifmt_ctx->pb = source->context();
+    if ((ret = avformat_open_input(&ifmt_ctx, in_filename ? in_filename : "", 0, 0)) < 0) {
+        printf("Could not open input file %s.\n", in_name);
+        goto end;
+    }
+    if ((ret = avformat_find_stream_info(ifmt_ctx, 0)) < 0) {
+        printf("Failed to retrieve input stream information\n");
+        goto end;
+    }
+
+    //Output
+    avformat_alloc_output_context2(&ofmt_ctx, NULL, out_format, out_filename);
+    if (!ofmt_ctx) {
+        printf("Could not create output context\n");
+        ret = AVERROR_UNKNOWN;
+        goto end;
+    }
+    stream_map.resize(ifmt_ctx->nb_streams, -1);
+    for (i = 0; i < ifmt_ctx->nb_streams; i++) {
+        //Create output AVStream according to input AVStream
+        AVStream *in_stream = ifmt_ctx->streams[i];
+        AVStream *out_stream;
+
+        if (!stream_wanted(opt->streams, i, in_stream))
+            continue;
+        if (avformat_query_codec(ofmt_ctx->oformat, in_stream->codec->codec_id, FF_COMPLIANCE_NORMAL) == 0) {
+            printf("Skipping stream %u: %s is not supported by %s\n", i,
+                   avcodec_get_name(in_stream->codec->codec_id), ofmt_ctx->oformat->name);
+            continue;
+        }
+        out_stream = avformat_new_stream(ofmt_ctx, in_stream->codec->codec);
+        if (!out_stream) {
+            printf("Failed allocating output stream\n");
+            ret = AVERROR_UNKNOWN;
+            goto end;
+        }
+        //Copy the settings of AVCodecContext
+        if ((ret = avcodec_copy_context(out_stream->codec, in_stream->codec)) < 0) {
+            printf("Failed to copy context from input to output stream codec context\n");
+            goto end;
+        }
+        out_stream->codec->codec_tag = 0;
+        if (ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+            out_stream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+        out_stream->time_base = in_stream->time_base;
+        stream_map[i] = nb_out++;
+    }
+    if (!nb_out) {
+        printf("No stream selected\n");
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+
+    //Cut points are relative to the start of the input
+    if (opt->start_time != AV_NOPTS_VALUE || opt->end_time != AV_NOPTS_VALUE) {
+        int64_t origin = ifmt_ctx->start_time != AV_NOPTS_VALUE ? ifmt_ctx->start_time : 0;
+        if (opt->start_time != AV_NOPTS_VALUE)
+            start_ts = origin + opt->start_time;
+        if (opt->end_time != AV_NOPTS_VALUE)
+            end_ts = origin + opt->end_time;
+        started.resize(ifmt_ctx->nb_streams, 0);
+        wait_end.resize(ifmt_ctx->nb_streams, 0);
+        // sparse streams (subtitles, data) may never reach the end point
+        for (i = 0; i < ifmt_ctx->nb_streams; i++) {
+            enum AVMediaType type = ifmt_ctx->streams[i]->codec->codec_type;
+            if (stream_map[i] >= 0 && (type == AVMEDIA_TYPE_VIDEO || type == AVMEDIA_TYPE_AUDIO))
+                wait_end[i] = 1;
+        }
+        for (i = 0; i < ifmt_ctx->nb_streams; i++)
+            nb_running += wait_end[i];
+        if (!nb_running) {
+            for (i = 0; i < ifmt_ctx->nb_streams; i++)
+                wait_end[i] = stream_map[i] >= 0;
+            nb_running = nb_out;
+        }
+    }
+    if (opt->smart && !started.empty()) {
+        int video = av_find_best_stream(ifmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+        if (video < 0 || stream_map[video] < 0) {
+            printf("Smart render needs a video stream, cutting at keyframes\n");
+        } else if (!smart_supported(ifmt_ctx->streams[video])) {
+            printf("Smart render needs H.264/HEVC with in band parameter sets (e.g. MPEG-TS), cutting at keyframes\n");
+        } else {
+            smart_stream = video;
+            // everything is cut at the same frame accurate start
+            offset = start_ts != AV_NOPTS_VALUE ? start_ts : 0;
+        }
+    }
+    if (start_ts != AV_NOPTS_VALUE && (ret = seek_to_start(ifmt_ctx, in_filename, start_ts)) < 0) {
+        printf("Could not seek to %.3fs in %s\n", opt->start_time / 1000000.0, in_name);
+        goto end;
+    }
+
+    //Open output file
+    if (!sink && !(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        sink = out_filename ? AvioSink::openFile(out_filename, opt->avio_buffer) : NULL;
+        if (!sink) {
+            printf("Could not open output file '%s'\n", out_filename ? out_filename : "");
+            ret = AVERROR(EIO);
+            goto end;
+        }
+    }
+    if (sink) {
+        ofmt_ctx->pb = sink->context();
+        // mp4 patches its header at the end; without seeking it has to be fragmented
+        if (!ofmt_ctx->pb->seekable && (strstr(ofmt_ctx->oformat->name, "mp4") || strstr(ofmt_ctx->oformat->name, "mov")))
+            av_dict_set(&header_opts, "movflags", "frag_keyframe+empty_moov", 0);
+    }
+    //Write file header
+    ret = avformat_write_header(ofmt_ctx, &header_opts);
+    av_dict_free(&header_opts);
+    if (ret < 0) {
+        printf("Error occurred when opening output file\n");
+        goto end;
+    }
+    if (smart_stream >= 0 &&
+        (ret = smart_open(&smart, ofmt_ctx, ifmt_ctx->streams[smart_stream],
+                          ofmt_ctx->streams[stream_map[smart_stream]], start_ts, end_ts)) < 0) {
+        smart_close(&smart);
+        smart_stream = -1;
+        goto end;
+    }
+
+    while (1) {
+        AVStream *in_stream, *out_stream;
+        //Get an AVPacket
+        if ((ret = av_read_frame(ifmt_ctx, &pkt)) < 0)
+            break;
+        if (pkt.stream_index >= (int)stream_map.size() || stream_map[pkt.stream_index] < 0) {
+            av_free_packet(&pkt);
+            continue;
+        }
+        in_stream  = ifmt_ctx->streams[pkt.stream_index];
+        out_stream = ofmt_ctx->streams[stream_map[pkt.stream_index]];
+
+        if (!started.empty()) {
+            int64_t t = pkt.dts != AV_NOPTS_VALUE ? pkt.dts : pkt.pts;
+            //Past the end point: stop reading once every stream got there
+            if (end_ts != AV_NOPTS_VALUE && t != AV_NOPTS_VALUE &&
+                av_compare_ts(t, in_stream->time_base, end_ts, AV_TIME_BASE_Q) >= 0) {
+                int last = wait_end[pkt.stream_index] && --nb_running == 0;
+                int smart_end = pkt.stream_index == smart_stream;
+                wait_end[pkt.stream_index] = 0;
+                av_free_packet(&pkt);
+                if (smart_end && (ret = smart_finish(&smart, 1)) < 0)
+                    break;
+                if (last)
+                    break;
+                continue;
+            }
+            if (pkt.stream_index == smart_stream) {
+                if ((ret = smart_video_packet(&smart, &pkt)) < 0)
+                    break;
+                continue;
+            }
+            //Smart render cuts the other streams at the exact start too
+            if (smart_stream >= 0 && start_ts != AV_NOPTS_VALUE && pkt.pts != AV_NOPTS_VALUE &&
+                av_compare_ts(pkt.pts, in_stream->time_base, start_ts, AV_TIME_BASE_Q) < 0) {
+                av_free_packet(&pkt);
+                continue;
+            }
+            //After the seek, video starts at its first keyframe
+            if (start_ts != AV_NOPTS_VALUE && !started[pkt.stream_index]) {
+                if (in_stream->codec->codec_type == AVMEDIA_TYPE_VIDEO && !(pkt.flags & AV_PKT_FLAG_KEY)) {
+                    av_free_packet(&pkt);
+                    continue;
+                }
+                started[pkt.stream_index] = 1;
+            }
+            //Rebase to zero: the first packet copied starts the output
+            if ((start_ts != AV_NOPTS_VALUE || offset != AV_NOPTS_VALUE) && t != AV_NOPTS_VALUE) {
+                int64_t shift;
+                if (offset == AV_NOPTS_VALUE)
+                    offset = av_rescale_q(t, in_stream->time_base, AV_TIME_BASE_Q);
+                shift = av_rescale_q(offset, AV_TIME_BASE_Q, in_stream->time_base);
+                if (pkt.pts != AV_NOPTS_VALUE)
+                    pkt.pts -= shift;
+                if (pkt.dts != AV_NOPTS_VALUE)
+                    pkt.dts -= shift;
+            }
+        }
+
+        //Convert PTS/DTS
+        av_packet_rescale_ts(&pkt, in_stream->time_base, out_stream->time_base);
+        pkt.stream_index = out_stream->index;
+        pkt.pos = -1;
+        stats->packets++;
+
+        //Write: the muxer takes over the packet's buffer reference, nothing is copied
+        if ((ret = av_interleaved_write_frame(ofmt_ctx, &pkt)) < 0) {
+            printf("Error muxing packet\n");
+            break;
+        }
+    }
+    if (ret == AVERROR_EOF)
+        ret = 0;
+    if (smart_stream >= 0) {
+        if (ret >= 0)
+            ret = smart_finish(&smart, 0);
+        printf("Smart render: %ld video packets copied, %ld re-encoded\n", smart.copied, smart.reencoded);
+        stats->packets += smart.copied + smart.reencoded;
+        smart_close(&smart);
+    }
+    if (ret >= 0) {
+        //Write file trailer
+        ret = av_write_trailer(ofmt_ctx);
+        if (ret >= 0 && sink)
+            ret = sink->finish();
+        if (sink)
+            stats->bytes_out = sink_bytes(sink);
+    }
+
+end:
+    stats->bytes_in = source->bytesRead();
+    stats->time = av_gettime_relative() - start;
+    avformat_close_input(&ifmt_ctx);
+    avformat_free_context(ofmt_ctx);
+    if (sink != out_sink) {
+        // do not leave a truncated file behind
+        if (ret < 0)
+            unlink(out_filename);
+        delete sink;
+    }
+    return ret;
+}
+
+int remux(const char *in_filename, const char *out_filename, const RemuxOptions *opt, RemuxStats *stats)
+{
+    AvioSource *source = AvioSource::openFile(in_filename, opt->avio_buffer);
+    int ret;
+
+    if (!source) {
+        memset(stats, 0, sizeof(*stats));
+        printf("Could not open input file %s.\n", in_filename);
+        return AVERROR(EIO);
+    }
+    ret = remux_io(source, in_filename, NULL, out_filename, NULL, opt, stats);
+    delete source;
+    return ret;
+}
+
+/* Library entry points: remux an object that is already in memory, or
+ * one that arrives through callbacks, without any temporary file. */
+
+int remux_memory(const uint8_t *data, size_t size, const char *format_name, std::vector<uint8_t>& out,
+                 const RemuxOptions *opt, RemuxStats *stats)
+{
+    AvioSource *source = AvioSource::openMemory(data, size);
+    // a remuxed file is about as big as its input
+    AvioSink *sink = AvioSink::openMemory(size);
+    int ret = AVERROR(ENOMEM);
+
+    memset(stats, 0, sizeof(*stats));
+    if (source && sink) {
+        ret = remux_io(source, NULL, sink, NULL, format_name, opt, stats);
+        if (ret >= 0)
+            sink->takeBuffer(out);
+    }
+    delete sink;
+    delete source;
+    return ret;
+}
+
+int remux_callbacks(AvioReadFunc read_fn, AvioSeekFunc read_seek_fn, void *read_opaque,
+                    AvioWriteFunc write_fn, AvioSinkSeekFunc write_seek_fn, void *write_opaque,
+                    const char *format_name, const RemuxOptions *opt, RemuxStats *stats)
+{
+    AvioSource *source = AvioSource::openCallback(read_fn, read_seek_fn, read_opaque);
+    AvioSink *sink = AvioSink::openCallback(write_fn, write_seek_fn, write_opaque);
+    int ret = AVERROR(ENOMEM);
+
+    memset(stats, 0, sizeof(*stats));
+    if (source && sink)
+        ret = remux_io(source, NULL, sink, NULL, format_name, opt, stats);
+    delete sink;
+    delete source;
+    return ret;
+}
@@ -0,0 +1,67 @@
+#pragma once
+/*
+ * 封装格式转换接口
+ * Remuxer library interface.
+ *
+ * Copies the streams of one container into another without decoding,
+ * from a file, a memory buffer or caller supplied read/write functions.
+ * The implementation is remux.cpp; link it together with the program.
+ *
+ *   RemuxOptions opt = { "all", 1 << 20, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0, 0 };
+ *   RemuxStats stats;
+ *   std::vector<uint8_t> out;
+ *   av_register_all();
+ *   if (remux_memory(in, in_size, "mpegts", out, &opt, &stats) < 0)
+ *       ...
+ */
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "libavformat/avformat.h"
+#ifdef __cplusplus
+};
+#endif
+#include "../../common/avio_source.h"
+#include "../../common/avio_sink.h"
+
+struct RemuxOptions {
+    const char *streams;    // "all", stream types ("va"), or stream indexes ("0,2")
+    int avio_buffer;        // bytes, for both the input and the output
+    int64_t start_time;     // AV_TIME_BASE units from the start of the input, AV_NOPTS_VALUE if not set
+    int64_t end_time;
+    int smart;              // re-encode the partial GOPs at the cut points
+    int memory;             // remux a copy of the input held in memory
+};
+
+struct RemuxStats {
+    int64_t bytes_in, bytes_out;
+    long packets;
+    int64_t time;           // us
+};
+
+/* Whether stream index should be copied. sel is "all", a list of
+ * v(ideo), a(udio), s(ubtitle), d(ata), or a comma separated list of
+ * stream indexes. */
+int stream_wanted(const char *sel, int index, const AVStream *st);
+
+/* Copies the selected streams of in_filename into out_filename, the
+ * container is picked from the output extension. */
+int remux(const char *in_filename, const char *out_filename, const RemuxOptions *opt, RemuxStats *stats);
+
+/* Remuxes size bytes at data into out, in the container format_name
+ * ("mp4", "mpegts", "matroska", ...). The input is seekable. */
+int remux_memory(const uint8_t *data, size_t size, const char *format_name, std::vector<uint8_t>& out,
+                 const RemuxOptions *opt, RemuxStats *stats);
+
+/* Remuxes what read_fn delivers into write_fn. Either seek function may
+ * be NULL: without input seeking, formats that keep their index at the
+ * end (mp4 with the moov last) cannot be read; without output seeking,
+ * mp4 is written fragmented. */
+int remux_callbacks(AvioReadFunc read_fn, AvioSeekFunc read_seek_fn, void *read_opaque,
+                    AvioWriteFunc write_fn, AvioSinkSeekFunc write_seek_fn, void *write_opaque,
+                    const char *format_name, const RemuxOptions *opt, RemuxStats *stats);